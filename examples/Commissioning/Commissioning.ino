@@ -0,0 +1,152 @@
+/* MIT License
+
+  Original concept:
+  Copyright (c) 2020 Ward Ramsdell
+
+  Extensively revised by:
+  Copyright (c) 2021 Arn Mulligan
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+/*
+   Find the highest bit rate an installation runs reliably at. Send 'c' over
+   Serial to step the bit rate up from 800kHz, showing a test pattern at each
+   step. The operator answers 'y' if it looks right and 'n' if not, or a light
+   sensor placed over the last pixel of channel 0 answers instead. The highest
+   good rate, less one step of margin, is stored in EEPROM and used from then on.
+*/
+
+#include <EEPROM.h>
+#include <TDWS28XX.h>
+using namespace TDWS28XX;
+
+const uint8_t NumberOfChannels = 16; // 8, 16 or 32
+const uint16_t NumberOfPixelsPerChannel = 100;
+
+const uint32_t FirstBitRate = 800000; // Hz
+const uint32_t LastBitRate = 1350000;
+const uint32_t BitRateStep = 50000;
+
+const int SensorPin = -1; // analog input of a light sensor, -1 to ask the operator
+const int SensorThreshold = 512;
+
+// bit rate persisted in EEPROM
+struct Config {
+  uint32_t magic;
+  uint32_t bitRate;
+};
+const int ConfigAddress = 0;
+const uint32_t ConfigMagic = 0x54445752;
+
+PixelBuffer<NumberOfPixelsPerChannel, TRICOLOR, SINGLE_BUFFER, NumberOfChannels> pb;
+PixelDriver pd(pb);
+uint32_t bitRate = 0; // 0 for the default timing
+
+bool applyBitRate(uint32_t rate) {
+  const BitTiming t = solveBitTiming(overclockProfile(rate), NumberOfChannels, solver::OverclockFlexClock);
+  if (! t.phases || ! pd.setBitTiming(t)) return false;
+  Serial.printf("%lu Hz asked, %lu Hz set\n", rate, 1000000000ul / t.bitPeriod);
+  return true;
+}
+
+// A red, green and blue sequence on all channels that shows any bit slip as
+// wrong colors; the last pixel of channel 0 is white or black for the sensor.
+void showPattern(bool lastLit) {
+  const Color colors[] = { rgb(32, 0, 0), rgb(0, 32, 0), rgb(0, 0, 32) };
+  for (uint8_t i = 0; i < NumberOfChannels; ++i) {
+    for (uint16_t j = 0; j < NumberOfPixelsPerChannel; ++j) {
+      pd.setPixel(i, j, colors[j % 3]);
+    }
+  }
+  pd.setPixel(0, NumberOfPixelsPerChannel - 1, lastLit ? rgb(255, 255, 255) : rgb(0, 0, 0));
+  pd.flushBuffer();
+  while (! pd.bufferReady());
+}
+
+bool patternGood() {
+  if (SensorPin >= 0) {
+    showPattern(true);
+    delay(50);
+    const int lit = analogRead(SensorPin);
+    showPattern(false);
+    delay(50);
+    const int dark = analogRead(SensorPin);
+    return lit > SensorThreshold && dark < SensorThreshold;
+  }
+  
+  showPattern(true);
+  Serial.println("red, green, blue pattern with a white last pixel on channel 0? (y/n)");
+  for (;;) {
+    const int c = Serial.read();
+    if (c == 'y') return true;
+    if (c == 'n') return false;
+  }
+}
+
+void commission() {
+  uint32_t good = 0;
+  for (uint32_t rate = FirstBitRate; rate <= LastBitRate; rate += BitRateStep) {
+    if (! applyBitRate(rate)) {
+      Serial.printf("%lu Hz not reachable\n", rate);
+      continue;
+    }
+    if (! patternGood()) break;
+    good = rate;
+  }
+  
+  // keep a step of margin
+  if (good > FirstBitRate) good -= BitRateStep;
+  if (! good || ! applyBitRate(good)) {
+    Serial.println("no reliable bit rate found, using the default timing");
+    pd.setBitTiming(defaultBitTiming(NumberOfChannels));
+    good = 0;
+  }
+  
+  bitRate = good;
+  const Config config = { ConfigMagic, bitRate };
+  EEPROM.put(ConfigAddress, config);
+}
+
+void setup() {
+  Serial.begin(115200);
+  
+  if (! pd.begin()) {
+    Serial.println("configuration error");
+    for (;;);
+  }
+  
+  for (uint8_t i = 0; i < NumberOfChannels; ++i) {
+    pd.setChannelType(i, GRB);
+  }
+  
+  Config config;
+  EEPROM.get(ConfigAddress, config);
+  if (config.magic == ConfigMagic && config.bitRate && applyBitRate(config.bitRate)) {
+    bitRate = config.bitRate;
+  }
+  Serial.println("send 'c' to commission the bit rate");
+}
+
+void loop() {
+  if (Serial.read() == 'c') commission();
+  
+  showPattern(true);
+  delay(20);
+}
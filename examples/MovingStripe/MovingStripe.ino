@@ -27,7 +27,8 @@
 
 /*
    Move a colored stripe back and forth along the pixel array to demonstrate
-   multi-channel capability.
+   multi-channel capability. Retained mode keeps the inactive buffer up to date
+   with the displayed frame, so each step only redraws what moved.
 */
 
 #include <TDWS28XX.h>
@@ -68,6 +69,7 @@ void setup() {
   for (uint8_t i = 0; i < NumberOfChannels; ++i) {
     pd.setChannelType(i, GRB);
   }
+  pd.setRetainedMode(true);
 
   // initialise the inactive buffer with background color
   paintBackground(BaseColor);
@@ -82,11 +84,9 @@ void setup() {
     pd.setInactivePixel(i, 0, color);
   }
 
-  // swap active buffer for inactive buffer thus updating the display
+  // swap active buffer for inactive buffer thus updating the display; the
+  // formerly active buffer is brought up to date with it
   pd.flipBuffers();
-
-  // initialise the formerly active buffer
-  paintBackground(BaseColor);
 }
 
 void loop() {
@@ -94,19 +94,15 @@ void loop() {
 
   const uint16_t newPosition = forward ? curPosition + 1 : curPosition - 1;
 
-  // draw stripe in new position
+  // move the stripe in the inactive buffer, which holds the displayed frame
   for (uint16_t i = 0; i < NumberOfChannels; ++i) {
-    pd.setInactivePixel(i, newPosition, pd.getActivePixel(i, curPosition));
+    pd.setInactivePixel(i, newPosition, pd.getInactivePixel(i, curPosition));
+    pd.setInactivePixel(i, curPosition, BaseColor);
   }
 
   // display the new stripe
   pd.flipBuffers();
 
-  // erase old stripe
-  for (uint16_t i = 0; i < NumberOfChannels; ++i) {
-    pd.setInactivePixel(i, curPosition, BaseColor);
-  }
-
   // housekeeping
   curPosition = newPosition;
   if (curPosition == 0 || curPosition + 1 == NumberOfPixelsPerChannel) {
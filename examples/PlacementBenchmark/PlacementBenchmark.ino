@@ -0,0 +1,120 @@
+/* MIT License
+
+  Copyright (c) 2021 Arn Mulligan
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+/*
+   Compare pixel buffer placements on Teensy 4.x to pick the fastest one for an
+   installation: for each placement, time encoding a whole frame with
+   setPixelRow() and time the flush part of flipBuffers(). Set the pixel count
+   and color capability to match the installation and read the results from
+   the serial monitor. Nothing needs to be connected to the output pins.
+*/
+
+#include <new>
+#include <TDWS28XX.h>
+using namespace TDWS28XX;
+
+const uint16_t NumberOfPixelsPerChannel = 300; // as installed
+const ColorCapability Capability = TRICOLOR;
+const unsigned Rounds = 20; // frames timed per placement
+
+// pools the allocator can draw from besides the heap and PSRAM
+uint8_t dtcmPool[pixelBufferSize(NumberOfPixelsPerChannel, Capability) * 2 + 256] __attribute__((aligned(32)));
+TDWS28XX_MPU_POOL(uncachedPool, 65536);
+TDWS28XX_MPU_POOL(writeThroughPool, 65536);
+
+struct Placement {
+  MemoryPlacement placement;
+  const char *name;
+};
+
+const Placement Placements[] = {
+  { DTCM_MEMORY, "DTCM" },
+  { OCRAM_MEMORY, "OCRAM" },
+  { OCRAM_UNCACHED_MEMORY, "OCRAM uncached" },
+  { OCRAM_WRITETHROUGH_MEMORY, "OCRAM write-through" },
+  { PSRAM_MEMORY, "PSRAM" },
+};
+
+Color row[32];
+
+// The driver holds the TCDs the DMA reads, so it lives in DTCM, which needs no
+// cache maintenance, rather than in the heap; one at a time is constructed in it.
+alignas(PixelDriver) uint8_t driverStorage[sizeof(PixelDriver)];
+
+void benchmark(const Placement &p) {
+  DynamicPixelBuffer buffer;
+  if (! buffer.allocate(NumberOfPixelsPerChannel, Capability, DOUBLE_BUFFER, p.placement)) {
+    Serial.printf("%-20s  not available\n", p.name);
+    return;
+  }
+
+  PixelDriver *pd = new (driverStorage) PixelDriver(buffer);
+  if (! pd->begin()) {
+    Serial.printf("%-20s  configuration error\n", p.name);
+    pd->~PixelDriver();
+    return;
+  }
+
+  uint32_t encodeCycles = 0;
+  uint32_t flipCycles = 0;
+  for (unsigned r = 0; r < Rounds; ++r) {
+    for (unsigned c = 0; c < 32; ++c) row[c] = rgb(r, c, r + c);
+
+    uint32_t t = ARM_DWT_CYCCNT;
+    for (uint16_t i = 0; i < NumberOfPixelsPerChannel; ++i) pd->setInactivePixelRow(i, row);
+    encodeCycles += ARM_DWT_CYCCNT - t;
+
+    // exclude the wait for the previous frame, only the flip itself is of interest
+    while (! pd->bufferReady());
+    t = ARM_DWT_CYCCNT;
+    pd->flipBuffers();
+    flipCycles += ARM_DWT_CYCCNT - t;
+  }
+  while (! pd->bufferReady());
+  pd->~PixelDriver();
+
+  const float usPerCycle = 1e6f / F_CPU_ACTUAL;
+  Serial.printf("%-20s  encode %8.1f us  flip %7.1f us  total %8.1f us\n", p.name,
+    encodeCycles * usPerCycle / Rounds, flipCycles * usPerCycle / Rounds,
+    (encodeCycles + flipCycles) * usPerCycle / Rounds);
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (! Serial && millis() < 3000);
+
+  addDtcmPool(dtcmPool, sizeof(dtcmPool));
+  if (! addMpuPool(uncachedPool, sizeof(uncachedPool), OCRAM_UNCACHED_MEMORY)) {
+    Serial.println("unable to configure uncached pool");
+  }
+  if (! addMpuPool(writeThroughPool, sizeof(writeThroughPool), OCRAM_WRITETHROUGH_MEMORY)) {
+    Serial.println("unable to configure write-through pool");
+  }
+
+  Serial.printf("%u pixels per channel, %s, %u bytes per buffer\n", NumberOfPixelsPerChannel,
+    Capability == TRICOLOR ? "TRICOLOR" : "QUADCOLOR", pixelBufferSize(NumberOfPixelsPerChannel, Capability));
+  for (const Placement &p : Placements) benchmark(p);
+}
+
+void loop() {
+}
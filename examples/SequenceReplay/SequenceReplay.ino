@@ -0,0 +1,109 @@
+/* MIT License
+
+  Original concept:
+  Copyright (c) 2020 Ward Ramsdell
+
+  Extensively revised by:
+  Copyright (c) 2021 Arn Mulligan
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+/*
+   Play a loop of three frames with no CPU involvement, stop it, and play it
+   twice more. Each replay must keep looping: after a loop time or more, the
+   sequence has to be still active, which the sketch reports over Serial.
+*/
+
+#include <TDWS28XX.h>
+using namespace TDWS28XX;
+
+const uint8_t NumberOfChannels = 8; // 8, 16 or 32
+const uint16_t NumberOfPixelsPerChannel = 100;
+
+const uint16_t Repeats = 30; // frame times each frame is shown
+const uint32_t LoopMs = 3 * Repeats * 4; // upper bound of a loop at the default timing
+
+PixelBuffer<NumberOfPixelsPerChannel, TRICOLOR, SINGLE_BUFFER, NumberOfChannels> pb;
+PixelDriver pd(pb);
+
+const size_t FrameSize = pixelBufferSize(NumberOfPixelsPerChannel, TRICOLOR, NumberOfChannels);
+DMAMEM uint8_t frameData[3][FrameSize] __attribute__((aligned(32)));
+ExternalFrame frames[3];
+SequenceBuffer<32> sequence;
+
+// Draw a frame in the driver's buffer and keep a copy of its bit planes.
+void renderFrame(unsigned f, const Color &color) {
+  for (uint8_t i = 0; i < NumberOfChannels; ++i) {
+    for (uint16_t j = 0; j < NumberOfPixelsPerChannel; ++j) {
+      pd.setPixel(i, j, (j % 3 == f) ? color : rgb(0, 0, 0));
+    }
+  }
+  memcpy(frameData[f], const_cast<uint8_t*>(pd.getActiveBufferPtr()), FrameSize);
+  frames[f] = { frameData[f], 0, 0 };
+  pd.registerFrame(frames[f]);
+}
+
+bool playAndCheck(const char *what) {
+  const bool played = pd.playSequence(sequence);
+  delay(2 * LoopMs);
+  const bool looping = pd.sequenceActive(sequence);
+  Serial.printf("%s: %s\n", what, (played && looping) ? "looping" : "FAILED");
+  return played && looping;
+}
+
+void setup() {
+  Serial.begin(115200);
+  
+  if (! pd.begin()) {
+    Serial.println("configuration error");
+    for (;;);
+  }
+  
+  for (uint8_t i = 0; i < NumberOfChannels; ++i) {
+    pd.setChannelType(i, GRB);
+  }
+  
+  renderFrame(0, rgb(32, 0, 0));
+  renderFrame(1, rgb(0, 32, 0));
+  renderFrame(2, rgb(0, 0, 32));
+  const SequenceFrame loop[3] = {
+    { &frames[0], Repeats, 0 },
+    { &frames[1], Repeats, 0 },
+    { &frames[2], Repeats, 0 }
+  };
+  if (! pd.buildSequence(sequence, loop, 3)) {
+    Serial.println("sequence does not fit");
+    for (;;);
+  }
+}
+
+void loop() {
+  // play, stop and play again, then stop and play once more
+  playAndCheck("play");
+  pd.stopSequence();
+  delay(2 * LoopMs);
+  Serial.printf("stop: %s\n", pd.sequenceActive(sequence) ? "FAILED" : "stopped");
+  playAndCheck("replay");
+  pd.stopSequence();
+  delay(2 * LoopMs);
+  playAndCheck("replay again");
+  pd.stopSequence();
+  delay(1000);
+}
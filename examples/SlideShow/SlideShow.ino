@@ -24,9 +24,9 @@
 /*
    Display a series of 180x16 pixel images from a MicroSD card on a Teensy 4.1.
 
-   Only 8 channels are used in this example, which isn't an efficient use of the library as
-   the same amount of RAM is used whether 1 or 32 channels are used. Better to use all 32
-   channels to avoid waste. The LED pixel strips are connected in pairs, one strip forward,
+   Only 8 channels are used in this example, so the pixel buffer is declared in the 8 channel
+   word mode: it uses a quarter of the RAM of the 32 channel mode and only the first shift
+   register is fitted (the bit clock is slower to match). The LED pixel strips are connected in pairs, one strip forward,
    one strip back. The first strip of each pair is connected to a shift register output pin;
    the second strip is connected to the end of the first strip and so is running in the
    opposite direction to the first. Top left of the PNG image is the first shift register
@@ -44,7 +44,7 @@
 using namespace TDWS28XX;
 
 
-const uint8_t NumberOfChannels = 8; // number of shift register outputs in use (max 32)
+const uint8_t NumberOfChannels = 8; // number of shift register outputs in use (8, 16 or 32)
 const uint16_t NumberOfPixelsPerChannel = 360; // total LEDs connected to a shift register output
 const uint16_t NumberOfPixelsPerRow = 180; // pixels per display row (must divide into NumberOfPixelsPerChannel)
 const unsigned long SlideShowIntervalMs = 3000; // delay between each displayed image
@@ -52,7 +52,7 @@ const uint8_t BrightnessPercent = 20; // dim the display to the corresponding pe
 
 
 const uint16_t NumberOfRows = NumberOfPixelsPerChannel / NumberOfPixelsPerRow * NumberOfChannels;
-DMAMEM PixelBuffer<NumberOfPixelsPerChannel, TRICOLOR, SINGLE_BUFFER> pb;
+DMAMEM PixelBuffer<NumberOfPixelsPerChannel, TRICOLOR, SINGLE_BUFFER, NumberOfChannels> pb;
 PixelDriver pd(pb);
 PNG png;
 SdFs sdfs;
@@ -0,0 +1,82 @@
+/* MIT License
+
+  Original concept:
+  Copyright (c) 2020 Ward Ramsdell
+
+  Extensively revised by:
+  Copyright (c) 2021 Arn Mulligan
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+/*
+   Compute a plasma effect per pixel index just before it is sent, so 32 strips
+   of 2000 pixels need no frame memory at all, only the 3KB ring the DMA reads.
+   The callback runs from the DMA interrupt and must keep ahead of the LEDs: the
+   serial monitor reports underruns and the longest slice encode.
+*/
+
+#include <TDWS28XX.h>
+using namespace TDWS28XX;
+
+const uint8_t NumberOfChannels = 32; // number of shift register outputs in use (max 32)
+const uint16_t NumberOfPixelsPerChannel = 2000; // total LED pixels connected to a shift register output
+const uint16_t PixelsPerSlice = 16;
+
+
+StreamBuffer<NumberOfPixelsPerChannel, PixelsPerSlice, TRICOLOR> sb; // ring in RAM1, no cache flushes
+PixelDriver pd(sb);
+
+uint8_t sine[256]; // 0 -> 255 -> 0 over one period
+volatile uint32_t phase; // advanced by the first block of each frame
+
+void plasma(uint16_t firstPixel, uint16_t count, Color *colors, void *) {
+  if (firstPixel == 0) phase = phase + 1;
+  const uint8_t t = phase;
+  for (uint16_t j = 0; j < count; ++j) {
+    const uint16_t x = firstPixel + j;
+    for (uint8_t i = 0; i < NumberOfChannels; ++i) {
+      const uint8_t v = sine[uint8_t(x + t)] / 2 + sine[uint8_t(4 * i - t)] / 2;
+      colors[32 * j + i] = grb(sine[v] / 8, sine[uint8_t(v + 85)] / 8, sine[uint8_t(v + 170)] / 8);
+    }
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+
+  for (unsigned i = 0; i < 256; ++i) sine[i] = 127.5f + 127.5f * sinf(i * 2 * PI / 256);
+
+  pd.setStreamCallback(plasma);
+  if (! pd.begin()) {
+    Serial.println("configuration error");
+    for (;;);
+  }
+
+  // some configuration
+  for (uint8_t i = 0; i < NumberOfChannels; ++i) {
+    pd.setChannelType(i, GRB);
+  }
+}
+
+void loop() {
+  delay(1000);
+  Serial.printf("underruns %lu, longest slice encode %lu cycles\n",
+    (unsigned long)pd.getUnderrunCount(), (unsigned long)pd.getMaxEncodeCycles());
+}
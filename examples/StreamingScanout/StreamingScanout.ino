@@ -0,0 +1,88 @@
+/* MIT License
+
+  Original concept:
+  Copyright (c) 2020 Ward Ramsdell
+
+  Extensively revised by:
+  Copyright (c) 2021 Arn Mulligan
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+/*
+   Drive 32 channels of 1000 pixels from compact RGB frames, three bytes per
+   pixel, instead of pixel buffers of 96 bytes per pixel index. The DMA sends a
+   small ring of two slices while its interrupt encodes the slice just sent
+   again, two slices ahead. Two frames are alternated for tear free updates.
+*/
+
+#include <TDWS28XX.h>
+using namespace TDWS28XX;
+
+const uint8_t NumberOfChannels = 32; // number of shift register outputs in use (max 32)
+const uint16_t NumberOfPixelsPerChannel = 1000; // total LED pixels connected to a shift register output
+const uint16_t PixelsPerSlice = 16; // ring size: 2 slices of 16 pixel indices take 3KB
+
+
+StreamBuffer<NumberOfPixelsPerChannel, PixelsPerSlice, TRICOLOR> sb; // ring in RAM1, no cache flushes
+DMAMEM CompactBuffer<NumberOfPixelsPerChannel, TRICOLOR> frames[2]; // 2 x 96KB in RAM2
+
+PixelDriver pd(sb);
+unsigned drawFrame = 0; // frame not being sent
+uint16_t offset = 0;
+
+void setup() {
+  Serial.begin(115200);
+
+  for (CompactStore &f : frames) memset(f.bptr, 0, NumberOfPixelsPerChannel * NumberOfChannels * 3);
+  pd.setStreamSource(frames[1]);
+  if (! pd.begin()) {
+    Serial.println("configuration error");
+    for (;;);
+  }
+
+  // some configuration
+  for (uint8_t i = 0; i < NumberOfChannels; ++i) {
+    pd.setChannelType(i, GRB);
+  }
+}
+
+void loop() {
+  // rainbow running along every strip, each channel a little ahead of the last
+  CompactStore &f = frames[drawFrame];
+  for (uint16_t j = 0; j < NumberOfPixelsPerChannel; ++j) {
+    for (uint8_t i = 0; i < NumberOfChannels; ++i) {
+      const uint8_t phase = (j + offset + 8 * i) & 0xff;
+      f.set(i, j, grb(phase / 8, (255 - phase) / 8, 4));
+    }
+  }
+  ++offset;
+
+  // wait until the other frame is no longer read before drawing into it
+  pd.setStreamSource(f);
+  while (! pd.bufferReady());
+  drawFrame ^= 1;
+
+  static uint32_t lastReportMs = 0;
+  if (millis() - lastReportMs >= 1000) {
+    lastReportMs = millis();
+    Serial.printf("underruns %lu, longest slice encode %lu cycles\n",
+      (unsigned long)pd.getUnderrunCount(), (unsigned long)pd.getMaxEncodeCycles());
+  }
+}
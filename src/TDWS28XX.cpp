@@ -27,27 +27,145 @@ SOFTWARE.
 
 #include "TDWS28XX.h"
 #include <FlexIO_t4.h>
+#include <new>
 
 static const uint32_t Zeros = 0u;
-static const uint32_t Ones = ~0u;
+static const uint32_t LaneZeros[2] = { 0u, 0u }; /* a data phase of any width */
 
 /* Some pixels require almost 300uS reset interval, so use that as default. */
-/* 1.25uS (bit duration) * 240 = 300uS (reset interval) */
-static unsigned const BitTimesPerResetTime = 240;
+/* 1.25uS (default bit duration) * 240 = 300uS (reset interval) */
+static uint16_t const DefaultResetInterval = 300;
 
 /* Maximum possible value of BITER/CITER field. */
 static uint16_t const MaxDMAIterationsPerTCD = DMA_TCD_BITER_MASK;
 
+/* Bytes per minor loop of the memory DMA: a cache line. */
+static size_t const MemoryDmaMinorLoopBytes = 32;
+
+/* STREAMING mode encodes from the DMA interrupt, so it must preempt most others. */
+static uint8_t const StreamInterruptPriority = 16;
+
+/* CPU cycles of the STREAMING interrupt besides encoding, with some margin. */
+static uint32_t const StreamInterruptCycles = 600;
+
 /* Adjust with scope for optimum value. */
 static unsigned const OutputPinDriveStrength = 4;
 
+/* Cortex-M7 data cache line size. */
+static size_t const CacheLineSize = 32;
+
+/* Address range of DTCM (RAM1) with the largest possible FlexRAM allocation. */
+static uintptr_t const DtcmStart = 0x20000000;
+static uintptr_t const DtcmEnd = 0x20080000;
+
+/* Address range of OCRAM (RAM2). */
+static uintptr_t const OcramStart = 0x20200000;
+static uintptr_t const OcramEnd = 0x20280000;
+
+/* MPU regions used for pixel buffer pools. The Teensy startup code uses the */
+/* low numbered regions and higher numbers take precedence where they overlap. */
+static uint32_t const MpuRegionUncached = 15;
+static uint32_t const MpuRegionWriteThrough = 14;
+
 static bool dmaEnabled(const DMAChannel &c) {
   return DMA_ERQ & (1 << c.channel);
 }
 
+/* Transpose a 32x32 bit matrix in place (Hacker's Delight, 7-3). With the */
+/* input loaded in reverse channel order, word n of the result holds bit n */
+/* (MSB first) of every channel, i.e. one bit plane of the pixel buffer. */
+static inline void transpose32(uint32_t *a) {
+  uint32_t m = 0x0000FFFF;
+  for (unsigned j = 16; j; j >>= 1, m ^= m << j) {
+    for (unsigned k = 0; k < 32; k = (k + j + 1) & ~j) {
+      uint32_t t = (a[k] ^ (a[k + j] >> j)) & m;
+      a[k] ^= t;
+      a[k + j] ^= t << j;
+    }
+  }
+}
+
+template<typename T>
+static inline void writePlanes(volatile T *buffer, const uint32_t *planes, unsigned count, uint32_t mask) {
+  if (mask == T(~0u)) {
+    while (count--) *buffer++ = T(*planes++);
+  } else {
+    while (count--) {
+      *buffer = T((*buffer & ~mask) | (*planes++ & mask));
+      ++buffer;
+    }
+  }
+}
+
+/* Spread the low 16 bits of x to the even bits. */
+static inline uint32_t spreadBits(uint32_t x) {
+  x &= 0xFFFFu;
+  x = (x | x << 8) & 0x00FF00FFu;
+  x = (x | x << 4) & 0x0F0F0F0Fu;
+  x = (x | x << 2) & 0x33333333u;
+  return (x | x << 1) & 0x55555555u;
+}
+
+/* 64 channels: word k of a bit plane interleaves half of each lane's plane, */
+/* lane 0 in the odd bits; see PixelDriver::setDataTransfer(). */
+static inline uint32_t laneWord(uint32_t lane0, uint32_t lane1, unsigned k) {
+  const unsigned shift = k ? 0 : 16;
+  return spreadBits(lane1 >> shift) | spreadBits(lane0 >> shift) << 1;
+}
+
+static inline void writePlanes(volatile uint8_t *buffer, uint8_t channels, const uint32_t *planes, unsigned count, uint32_t mask) {
+  switch (channels) {
+    case 8: writePlanes(buffer, planes, count, mask & 0xFFu); break;
+    case 16: writePlanes(reinterpret_cast<volatile uint16_t*>(buffer), planes, count, mask & 0xFFFFu); break;
+    default: writePlanes(reinterpret_cast<volatile uint32_t*>(buffer), planes, count, mask); break;
+  }
+}
+
 namespace TDWS28XX {
 
+/* Call f(offset, length) for each run of consecutive blocks set in a dirty */
+/* map, clipped to the buffer size. */
+template<typename F>
+static void forEachDirtyRun(const uint32_t *map, size_t count, uint8_t shift, size_t size, F f) {
+  size_t i = 0;
+  while (i < count) {
+    if (! map[i >> 5]) {
+      i = (i | 31) + 1;
+      continue;
+    }
+    if (! (map[i >> 5] & (1u << (i & 31)))) {
+      ++i;
+      continue;
+    }
+    size_t j = i + 1;
+    while (j < count && (map[j >> 5] & (1u << (j & 31)))) ++j;
+    const size_t offset = i << shift;
+    size_t length = (j - i) << shift;
+    if (offset + length > size) length = size - offset;
+    f(offset, length);
+    i = j;
+  }
+}
+
+/* Load the colors of all channels of one pixel index in reverse channel order, */
+/* ready for transpose32(); the channels beyond a narrow mode's count stay zero. */
+static inline void loadPlanes(uint32_t *planes, const Color *colors, uint8_t channels) {
+  for (unsigned i = 0; i < 32; ++i) planes[i] = (i >= 32u - channels) ? colors[31 - i].raw : 0;
+}
+
+static inline void loadPlanes(uint32_t *planes, const CompactStore *store, uint16_t pixelIndex) {
+  const uint8_t *b = store->bptr + size_t(pixelIndex) * store->chs * store->bpc;
+  uint32_t *p = planes + 32;
+  for (unsigned c = 0; c < store->chs; ++c, b += store->bpc) {
+    uint32_t raw = uint32_t(b[0]) << 24 | uint32_t(b[1]) << 16 | uint32_t(b[2]) << 8;
+    if (store->bpc == 4) raw |= b[3];
+    *--p = raw;
+  }
+  while (p != planes) *--p = 0;
+}
+
 unsigned PixelDriver::instanceCount = 0;
+uint8_t PixelDriver::pllDiv = 0;
 PixelDriver *PixelDriver::instances[] = { };
 
 void dmaIsr0() {
@@ -60,24 +178,332 @@ void dmaIsr1() {
 
 void (*dmaISRs[])() = { dmaIsr0, dmaIsr1 };
 
+void memoryDmaIsr0() {
+  PixelDriver::instances[0]->memoryDmaIsr();
+}
+
+void memoryDmaIsr1() {
+  PixelDriver::instances[1]->memoryDmaIsr();
+}
+
+void (*memoryDmaISRs[])() = { memoryDmaIsr0, memoryDmaIsr1 };
+
+void keepAliveIsr0() {
+  PixelDriver::instances[0]->resumeRefresh(false);
+}
+
+void keepAliveIsr1() {
+  PixelDriver::instances[1]->resumeRefresh(false);
+}
+
+void (*keepAliveISRs[])() = { keepAliveIsr0, keepAliveIsr1 };
+
+/* Each allocation is preceded by its bookkeeping, just below the aligned block. */
+struct AllocationHeader {
+  uint8_t *raw;
+  size_t size;
+  MemoryPlacement placement;
+};
+
+/* Memory donated by the application, handed out stack fashion. */
+struct MemoryPool {
+  uint8_t *base;
+  size_t size;
+  size_t used;
+  MemoryPlacement placement;
+};
+
+static MemoryPool memoryPools[6];
+
+static bool addPool(void *pool, size_t size, MemoryPlacement placement) {
+  /* Trim the pool to whole cache lines */
+  const uintptr_t a = reinterpret_cast<uintptr_t>(pool);
+  const uintptr_t b = (a + CacheLineSize - 1) & ~(CacheLineSize - 1);
+  if (b - a >= size) return false;
+  size = (size - (b - a)) & ~(CacheLineSize - 1);
+  
+  for (MemoryPool &p : memoryPools) {
+    if (p.base) continue;
+    p.base = reinterpret_cast<uint8_t*>(b);
+    p.size = size;
+    p.used = 0;
+    p.placement = placement;
+    return true;
+  }
+  return false;
+}
+
+bool addDtcmPool(void *pool, size_t size) {
+  uintptr_t a = reinterpret_cast<uintptr_t>(pool);
+  if (a < DtcmStart || a + size > DtcmEnd) return false;
+  return addPool(pool, size, DTCM_MEMORY);
+}
+
+bool addMpuPool(void *pool, size_t size, MemoryPlacement placement) {
+  uintptr_t a = reinterpret_cast<uintptr_t>(pool);
+  uint32_t attributes;
+  uint32_t region;
+  
+  switch (placement) {
+    case OCRAM_UNCACHED_MEMORY:
+      attributes = SCB_MPU_RASR_TEX(1); /* normal memory, not cacheable */
+      region = MpuRegionUncached;
+      break;
+    case OCRAM_WRITETHROUGH_MEMORY:
+      attributes = SCB_MPU_RASR_C; /* normal memory, write-through, no write allocate */
+      region = MpuRegionWriteThrough;
+      break;
+    default:
+      return false;
+  }
+  
+  /* An MPU region is a power of two in size, at least 32 bytes, aligned to its size. */
+  if (size < 32 || (size & (size - 1)) || (a & (size - 1))) return false;
+  if (a < OcramStart || a + size > OcramEnd) return false;
+  
+  /* Only one pool per region; the region is in use if already enabled. */
+  SCB_MPU_RNR = region;
+  if (SCB_MPU_RASR & SCB_MPU_RASR_ENABLE) return false;
+  
+  unsigned log2size = 0;
+  while ((size_t(1) << (log2size + 1)) <= size) ++log2size;
+  
+  /* Write back and discard any cached lines before the attributes change. */
+  arm_dcache_flush_delete(pool, size);
+  
+  __disable_irq();
+  __asm__ volatile ("DMB");
+  SCB_MPU_RBAR = a | SCB_MPU_RBAR_REGION(region) | SCB_MPU_RBAR_VALID;
+  SCB_MPU_RASR = attributes | SCB_MPU_RASR_XN | SCB_MPU_RASR_AP(3)
+    | SCB_MPU_RASR_SIZE(log2size - 1) | SCB_MPU_RASR_ENABLE;
+  __asm__ volatile ("DSB");
+  __asm__ volatile ("ISB");
+  __enable_irq();
+  
+  return addPool(pool, size, placement);
+}
+
+bool pixelMemoryNeedsFlush(const void *memory) {
+  const uintptr_t a = reinterpret_cast<uintptr_t>(memory);
+  if (a >= DtcmStart && a < DtcmEnd) return false;
+  for (const MemoryPool &p : memoryPools) {
+    if (a >= reinterpret_cast<uintptr_t>(p.base) && a < reinterpret_cast<uintptr_t>(p.base) + p.size) {
+      return p.placement != OCRAM_UNCACHED_MEMORY && p.placement != OCRAM_WRITETHROUGH_MEMORY;
+    }
+  }
+  return true;
+}
+
+void* allocatePixelMemory(size_t size, MemoryPlacement placement) {
+  if (! size) return nullptr;
+  
+  /* Round up to whole cache lines and leave room for the header and alignment. */
+  size = (size + CacheLineSize - 1) & ~(CacheLineSize - 1);
+  const size_t total = size + sizeof(AllocationHeader) + CacheLineSize - 1;
+  uint8_t *raw = nullptr;
+  
+  switch (placement) {
+    case DTCM_MEMORY:
+    case OCRAM_UNCACHED_MEMORY:
+    case OCRAM_WRITETHROUGH_MEMORY:
+      for (MemoryPool &p : memoryPools) {
+        if (p.base && p.placement == placement && p.size - p.used >= total) {
+          raw = p.base + p.used;
+          p.used += total;
+          break;
+        }
+      }
+      break;
+      
+    case OCRAM_MEMORY:
+      raw = static_cast<uint8_t*>(malloc(total));
+      break;
+      
+    case PSRAM_MEMORY:
+#if defined ARDUINO_TEENSY41
+      /* extmem_malloc() silently falls back to the heap if there is no PSRAM. */
+      if (external_psram_size) raw = static_cast<uint8_t*>(extmem_malloc(total));
+#endif
+      break;
+  }
+  if (! raw) return nullptr;
+  
+  uintptr_t a = reinterpret_cast<uintptr_t>(raw) + sizeof(AllocationHeader);
+  a = (a + CacheLineSize - 1) & ~(CacheLineSize - 1);
+  AllocationHeader *h = reinterpret_cast<AllocationHeader*>(a) - 1;
+  h->raw = raw;
+  h->size = total;
+  h->placement = placement;
+  return reinterpret_cast<void*>(a);
+}
+
+void freePixelMemory(void *memory) {
+  if (! memory) return;
+  AllocationHeader *h = static_cast<AllocationHeader*>(memory) - 1;
+  
+  switch (h->placement) {
+    case DTCM_MEMORY:
+    case OCRAM_UNCACHED_MEMORY:
+    case OCRAM_WRITETHROUGH_MEMORY:
+      /* Pools are stacks: only the most recent allocation is given back. */
+      for (MemoryPool &p : memoryPools) {
+        if (p.base && h->raw + h->size == p.base + p.used) {
+          p.used -= h->size;
+          break;
+        }
+      }
+      break;
+      
+    case OCRAM_MEMORY:
+      free(h->raw);
+      break;
+      
+    case PSRAM_MEMORY:
+#if defined ARDUINO_TEENSY41
+      extmem_free(h->raw);
+#endif
+      break;
+  }
+}
+
+bool DynamicPixelBuffer::allocate(uint16_t pixelsPerStrip, ColorCapability colorCapability,
+    BufferMode bufferMode, MemoryPlacement placement, uint8_t channels, uint8_t buffers) {
+  release();
+  if (! pixelsPerStrip) return false;
+  if (channels != 8 && channels != 16 && channels != 32 && channels != 64) return false;
+  if (bufferMode == STREAMING) return false; /* see allocateStream() */
+  if (! buffers) buffers = pixelBufferCount(bufferMode);
+  if (buffers != pixelBufferCount(bufferMode)
+    && (bufferMode != QUEUED_CONTINUOUS || buffers < 3 || buffers > MaxQueuedBuffers)) return false;
+  
+  const size_t sz = pixelBufferSize(pixelsPerStrip, colorCapability, channels);
+  uint8_t *b = static_cast<uint8_t*>(allocatePixelMemory(sz * buffers, placement));
+  if (! b) return false;
+  
+  p = { pixelsPerStrip, colorCapability, bufferMode, sz, b, channels, buffers };
+  return true;
+}
+
+bool DynamicPixelBuffer::allocateStream(uint16_t pixelsPerStrip, uint16_t slicePixels,
+    ColorCapability colorCapability, MemoryPlacement placement, uint8_t channels) {
+  release();
+  if (! slicePixels || slicePixels > pixelsPerStrip) return false;
+  if (channels != 8 && channels != 16 && channels != 32) return false;
+  
+  const size_t sz = pixelBufferSize(2 * slicePixels, colorCapability, channels);
+  uint8_t *b = static_cast<uint8_t*>(allocatePixelMemory(sz, placement));
+  if (! b) return false;
+  
+  p = { pixelsPerStrip, colorCapability, STREAMING, sz, b, channels, 1 };
+  return true;
+}
+
+void DynamicPixelBuffer::release() {
+  freePixelMemory(p.bptr);
+  p = InternalProperties();
+}
+
 PixelDriver::PixelDriver(const InternalProperties* ip_)
   : ip(ip_)
-  , dmasDataSegmentsCount(ip->bsz / sizeof(uint32_t) / MaxDMAIterationsPerTCD + 1)
+  , dmasDataSegmentsCount(0)
+  , flexIOModule(FLEXIO1)
+  , flexPins()
+  , pFlex(nullptr)
+  , dmasDataSegments(dmasEmbeddedSegments)
+  , channelTypes()
+  , quadChannels(0)
+  , flushRequired(true)
+  , dirtyTracking(false)
+  , dirtyBlockShift(5)
+  , dirtyMaps()
+  , activeBuffer(nullptr)
+  , inactiveBuffer(nullptr)
+  , activeSlot(0)
+  , inactiveSlot(0)
+  , freeBuffers()
+  , readyBuffers()
+  , renderBufferHeld(false)
+  , queuePolicy(LATEST_FRAME)
+  , droppedFrames(0)
+  , retained(false)
+  , retainPending(false)
+  , retainMap()
+  , requestedFrame(nullptr)
+  , shownFrame(nullptr)
+  , frameRequested(false)
+  , playingSequence(nullptr)
+  , streamSource(nullptr)
+  , streamCallback(nullptr)
+  , streamContext(nullptr)
+  , pendingSource(nullptr)
+  , pendingCallback(nullptr)
+  , pendingContext(nullptr)
+  , sourcePending(false)
+  , streamSlicePixels(0)
+  , streamSlices(0)
+  , streamPasses(0)
+  , streamSeen(0)
+  , streamFrame(0)
+  , streamHeld()
+  , streamSourceFrame(0)
+  , streamUnderruns(0)
+  , streamMaxCycles(0)
+  , timing()
+  , onesPatterns()
+  , activePixels(0)
+  , lengthPending(false)
+  , segmentBytes(0)
+  , truncating(false)
+  , resetMicroseconds(DefaultResetInterval)
+  , resetBitTimes(0)
+  , swapRequested(false)
+  , frameCount(0)
+  , frameCallback(nullptr)
+  , frameContext(nullptr)
+  , sleepWhileWaiting(false)
+  , clockOutputs(0)
+  , clockPatterns()
+  , globalBrightness(31)
+  , idleAfter(0)
+  , unchangedFrames(0)
+  , idling(false)
+  , idleSince(0)
+  , idleMicros(0)
+  , statsSince(0)
+  , memDma(false)
+  , memDmaEnabled(false)
+  , memBusy(false)
+  , memPattern(0)
+  , memTo(nullptr)
+  , memFrom(nullptr)
+  , memRemaining(0)
+  , memCallback(nullptr)
+  , memContext(nullptr)
 {
-  const size_t c = sizeof(dmasDataSegments) / sizeof(*dmasDataSegments);
-  if (dmasDataSegmentsCount > c) *const_cast<unsigned*>(&dmasDataSegmentsCount) = c;
 }
 
 PixelDriver::~PixelDriver() {
+  end();
+}
+
+void PixelDriver::end() {
+  if (! pFlex) return;
   --instanceCount;
   
   /* Disable peripherals */
+  keepAliveTimer.end();
+  setMemoryDma(false);
   configureDma(false);
+  releaseSegments();
+  releaseFrames();
   configureFlexIO(false);
   configurePins(false);
   if (! instanceCount) configurePll5(false);
   
   instances[flexIOModule] = nullptr;
+  pFlex = nullptr;
+  playingSequence = nullptr;
+  idling = false;
 }
 
 bool PixelDriver::begin(FlexIOModule flexIOModule_, FlexPins flexPins_) {
@@ -85,7 +511,15 @@ bool PixelDriver::begin(FlexIOModule flexIOModule_, FlexPins flexPins_) {
   flexPins = flexPins_;
   
   /* Sanity */
-  if (! ip->pxls) return false;
+  if (! ip->pxls || ! ip->bptr) return false;
+  if (ip->chs != 8 && ip->chs != 16 && ip->chs != 32 && ip->chs != 64) return false;
+  if (ip->chs == 64 && ip->bm == STREAMING) return false;
+  if ((flexPins.SRCLK == NoPin) != (flexPins.RCLK == NoPin)) return false;
+  if (direct() && ip->chs > 16) return false;
+  if (clocked() && (ip->cc != QUADCOLOR || ip->bm == STREAMING || direct())) return false;
+  if (clocked() && (uint64_t(clockOutputs) >> laneChannels() || clockOutputs == ~0u >> (32 - laneChannels()))) return false;
+  if (ip->bcnt < pixelBufferCount(ip->bm) || ip->bcnt > MaxBufferSlots) return false;
+  if ((reinterpret_cast<uintptr_t>(ip->bptr) | ip->bsz) & (CacheLineSize - 1)) return false;
   if (flexIOModule > FLEXIO2) return false;
   if (pFlex) return false;
 
@@ -95,28 +529,71 @@ bool PixelDriver::begin(FlexIOModule flexIOModule_, FlexPins flexPins_) {
   /* Exlusive use of PLL5 is desirable */
   if (! instanceCount && ! (CCM_ANALOG_PLL_VIDEO & CCM_ANALOG_PLL_VIDEO_POWERDOWN)) return false;
   
+  /* The bit timing must suit the buffer and, with two drivers, the PLL. */
+  if (! timing.phases) timing = clocked() ? clockedBitTiming(5, laneChannels()) : defaultBitTiming(laneChannels());
+  if (! timingUsable(timing)) return false;
+  resetBitTimes = bitTimesOf(resetMicroseconds);
+  if (! resetBitTimes || resetBitTimes > MaxDMAIterationsPerTCD) return false;
+  
+  /* Send all pixels unless told otherwise before. */
+  if (! activePixels || activePixels > ip->pxls || ip->bm == STREAMING) activePixels = ip->pxls;
+  lengthPending = false;
+  
   /* Get a FlexIO channel */
   FlexIOHandler *pf = FlexIOHandler::flexIOHandler_list[flexIOModule];
   
   /* Validate supplied pins */
-  if (pf->mapIOPinToFlexPin(flexPins.SRCLK) == 0xff) return false;
-  if (pf->mapIOPinToFlexPin(flexPins.RCLK) == 0xff) return false;
+  if (! direct() && pf->mapIOPinToFlexPin(flexPins.SRCLK) == 0xff) return false;
+  if (! direct() && pf->mapIOPinToFlexPin(flexPins.RCLK) == 0xff) return false;
   if (pf->mapIOPinToFlexPin(flexPins.SER) == 0xff) return false;
+  for (unsigned i = 1; i < dataPins(); ++i) {
+    if (pf->mapFlexPinToIOPin(pf->mapIOPinToFlexPin(flexPins.SER) + i) == 0xff) return false;
+  }
   
+  /* The buffer may have been sized at run time, so size the TCD chain now; */
+  /* long strips need more data segments than are embedded in the driver. */
+  unsigned segments = 3;
+  if (ip->bm == STREAMING) {
+    /* Two ring slices per pass, plus a pass with the last slice and the frame end */
+    streamSlicePixels = ip->bsz / 2 / strideOf(streamBits());
+    if (! streamSlicePixels) return false;
+    if (2 * streamSlicePixels * streamBits() > MaxDMAIterationsPerTCD) return false;
+    streamSlices = (ip->pxls + streamSlicePixels - 1) / streamSlicePixels;
+    streamPasses = (streamSlices + 1) / 2;
+    segments = streamPasses;
+    if (! streamBudgetMet(pendingSource, resetBitTimes)) return false;
+  } else {
+    const size_t words = ip->bsz / (ip->chs / 8u);
+    segments = (words + MaxDMAIterationsPerTCD - 1) / MaxDMAIterationsPerTCD;
+  }
+  if (! allocateSegments(segments)) return false;
+
   /* Init instances for ISR use */
   instances[flexIOModule] = this;
   
-  /* Set up buffer pointers */
-  activeBuffer = reinterpret_cast<uint32_t*>(ip->bptr);
-  inactiveBuffer = (ip->bm == DOUBLE_BUFFER_CONTINUOUS || ip->bm == DOUBLE_BUFFER)
-    ? reinterpret_cast<uint32_t*>(ip->bptr + ip->bsz)
-    : activeBuffer;
+  /* Set up buffer pointers; in QUEUED_CONTINUOUS mode the buffers beyond */
+  /* the first two start out free. */
+  activeBuffer = ip->bptr;
+  inactiveBuffer = (ip->bcnt > 1) ? bufferOf(1) : activeBuffer;
+  activeSlot = 0;
+  inactiveSlot = (ip->bcnt > 1) ? 1 : 0;
+  freeBuffers = SlotQueue();
+  readyBuffers = SlotQueue();
+  for (unsigned i = 2; i < ip->bcnt; ++i) freeBuffers.push(i);
+  renderBufferHeld = true;
   
   /* Initialise buffers */
-  memset(const_cast<uint32_t*>(activeBuffer), 0, ip->bsz);
-  arm_dcache_flush((uint8_t *)activeBuffer, ip->bsz);
-  memset(const_cast<uint32_t*>(inactiveBuffer), 0, ip->bsz);
-  arm_dcache_flush((uint8_t *)inactiveBuffer, ip->bsz);
+  flushRequired = pixelMemoryNeedsFlush(ip->bptr);
+  dirtyBlockShift = 5; /* cache line */
+  while ((ip->bsz >> dirtyBlockShift) >= DirtyMapWords * 32) ++dirtyBlockShift;
+  memset(dirtyMaps, 0, sizeof(dirtyMaps));
+  for (unsigned i = 0; i < ip->bcnt; ++i) {
+    volatile uint8_t *b = bufferOf(i);
+    memset(const_cast<uint8_t*>(b), 0, ip->bsz);
+    if (clocked()) setClockBits(b);
+    markDirtyBytes(b, 0, ip->bsz);
+    flushCache(b);
+  }
 
   /* Now configure the peripherals */
   pFlex = pf;
@@ -130,22 +607,478 @@ bool PixelDriver::begin(FlexIOModule flexIOModule_, FlexPins flexPins_) {
 }
 
 void PixelDriver::dmaIsr(void) {
-  /* Disable interrupt in the TCD */
-  dmasSetZeros.TCD->CSR &= ~DMA_TCD_CSR_INTMAJOR;
+  if (ip->bm == STREAMING) {
+    streamIsr();
+    return;
+  }
+  
+  /* Single refresh modes interrupt when the frame is complete. */
+  if (ip->bm == SINGLE_BUFFER || ip->bm == DOUBLE_BUFFER) {
+    dmaChannel.clearInterrupt();
+    endFrame();
+    __asm__ volatile ("DSB");
+    return;
+  }
 
-  /* Swap the buffer pointers in the TCDs */
-  volatile uint32_t *bptr = activeBuffer;
-  for (unsigned i = 0; i < dmasDataSegmentsCount; ++i) {
-    dmasDataSegments[i].TCD->SADDR = bptr;
-    bptr += MaxDMAIterationsPerTCD;
+  /* Continuous modes interrupt at every frame blanking period. */
+  if (takeNextFrame()) {
+    unchangedFrames = 0;
+  } else if (idleAfter && ++unchangedFrames >= idleAfter &&
+             uintptr_t(dmaChannel.TCD->DLASTSGA) == reinterpret_cast<uintptr_t>(dmasPresetZeros.TCD)) {
+    /* Repeated often enough: stop at the end of the reset period being */
+    /* sent, see resumeRefresh(). Else try again next frame. */
+    dmaChannel.TCD->CSR |= DMA_TCD_CSR_DREQ;
+    idling = true;
+    idleSince = micros();
   }
 
   /* Clear the interrupt so we don't get triggered again */
   dmaChannel.clearInterrupt();
+  endFrame();
   __asm__ volatile ("DSB");
   __asm__ volatile ("ISB");
 }
 
+bool PixelDriver::takeNextFrame() {
+  /* An external frame replaces the internal buffers until the next flip. */
+  bool changed = takeFrameRequest();
+  if (ip->bm == QUEUED_CONTINUOUS && ! shownFrame && presentQueued()) changed = true;
+  if (swapRequested) {
+    swapRequested = false;
+    changed = true;
+  }
+
+  /* Swap the buffer pointers in the TCDs */
+  if (changed || lengthPending) {
+    updateSegments(shownFrame ? const_cast<uint8_t*>(shownFrame->bptr) : activeBuffer);
+  }
+  return changed;
+}
+
+void PixelDriver::resumeRefresh(bool wait) {
+  /* Runs from flips and from the keep-alive timer, whichever comes first. */
+  /* The DMA stops by itself after the reset period sent last, at most that */
+  /* long: flips wait it out, the timer tries again on its next tick rather */
+  /* than spin in its interrupt. Only a stopped DMA is restarted. */
+  if (wait) {
+    while (idling && dmaEnabled(dmaChannel));
+  }
+  __disable_irq();
+  const bool resume = idling && ! dmaEnabled(dmaChannel);
+  if (resume) idling = false;
+  __enable_irq();
+  if (! resume) return;
+
+  /* The change is taken up here as no frame interrupt will come; without */
+  /* one, a single keep-alive frame is sent before idling again. */
+  idleMicros += micros() - idleSince;
+  unchangedFrames = takeNextFrame() ? 0 : idleAfter - 1;
+  dmaChannel = dmasPresetZeros;
+  dmaChannel.enable();
+}
+
+void PixelDriver::endFrame() {
+  ++frameCount;
+  if (frameCallback) frameCallback(frameContext);
+}
+
+bool PixelDriver::presentQueued() {
+  /* Runs every frame once the data has been sent: the buffer just sent is */
+  /* free again if a ready one takes its place. */
+  uint8_t slot;
+  if (! readyBuffers.pop(slot)) return false;
+  
+  uint8_t newer;
+  while (queuePolicy == LATEST_FRAME && readyBuffers.pop(newer)) {
+    freeBuffers.push(slot);
+    slot = newer;
+    ++droppedFrames;
+  }
+  freeBuffers.push(activeSlot);
+  activeBuffer = bufferOf(slot);
+  activeSlot = slot;
+  return true;
+}
+
+bool PixelDriver::takeFrameRequest() {
+  /* The reference of the request passes to the frame being sent. */
+  if (! frameRequested) return false;
+  frameRequested = false;
+  if (shownFrame) --shownFrame->refs;
+  shownFrame = requestedFrame;
+  return true;
+}
+
+void PixelDriver::requestFrame(ExternalFrame *frame) {
+  __disable_irq();
+  setFrameRequest(frame);
+  __enable_irq();
+}
+
+void PixelDriver::setFrameRequest(ExternalFrame *frame) {
+  if (frameRequested && requestedFrame) --requestedFrame->refs;
+  if (frame) ++frame->refs;
+  requestedFrame = frame;
+  frameRequested = true;
+}
+
+void PixelDriver::releaseFrames() {
+  if (frameRequested && requestedFrame) --requestedFrame->refs;
+  if (shownFrame) --shownFrame->refs;
+  frameRequested = false;
+  requestedFrame = nullptr;
+  shownFrame = nullptr;
+}
+
+bool PixelDriver::registerFrame(ExternalFrame &frame) {
+  if (! pFlex || ! frame.bptr) return false;
+  if (reinterpret_cast<uintptr_t>(frame.bptr) & (CacheLineSize - 1)) return false;
+  
+  /* Write the frame back to memory once, so presenting it needs no flush. */
+  if (pixelMemoryNeedsFlush(frame.bptr)) arm_dcache_flush(const_cast<uint8_t*>(frame.bptr), ip->bsz);
+  frame.bsz = ip->bsz;
+  return true;
+}
+
+bool PixelDriver::presentFrame(ExternalFrame &frame) {
+  if (ip->bm != DOUBLE_BUFFER_CONTINUOUS && ip->bm != QUEUED_CONTINUOUS) return false;
+  if (frame.bsz != ip->bsz) return false; /* not registered with this layout */
+  requestFrame(&frame);
+  resumeRefresh();
+  return true;
+}
+
+bool PixelDriver::acquireBuffer() {
+  uint8_t slot;
+  if (! freeBuffers.pop(slot)) return false;
+  inactiveBuffer = bufferOf(slot);
+  inactiveSlot = slot;
+  renderBufferHeld = true;
+  return true;
+}
+
+void PixelDriver::streamIsr() {
+  dmaChannel.clearInterrupt();
+  const uint32_t start = ARM_DWT_CYCCNT;
+
+  /* Where the DMA is comes from the DMA itself, so interrupts lost or */
+  /* merged cost stale slices at worst, never the place in the frame. */
+  /* Going back, or between frames again, means another frame has begun. */
+  const unsigned q = streamOrdinal();
+  const unsigned seen = streamSeen;
+  const bool between = q == streamSlices;
+  const unsigned expected = (seen < streamSlices) ? seen + 1 : (streamSlices > 1) ? 1 : streamSlices;
+  if (q != expected) ++streamUnderruns; /* interrupts were lost */
+  if (q < seen || (between && seen == streamSlices)) ++streamFrame;
+  const bool frameEnded = between || (q < seen && seen < streamSlices);
+  streamSeen = q;
+
+  /* Each slot not being read gets the next slice read from it: the next one */
+  /* of this frame, or the first or second of the next frame, which takes */
+  /* up a new source with whichever of them is encoded first. */
+  const size_t sliceBytes = streamSlicePixels * strideOf(streamBits());
+  const uintptr_t ring = reinterpret_cast<uintptr_t>(ip->bptr);
+  for (unsigned slot = 0; slot < 2 && slot < streamSlices; ++slot) {
+    if (! between && (q & 1) == slot) continue;
+    uint32_t frame = streamFrame;
+    unsigned slice = q + 1;
+    if (slice >= streamSlices) {
+      slice = slot;
+      ++frame;
+    }
+    const uint32_t held = frame * streamSlices + slice;
+    if (streamHeld[slot] == held) continue;
+    if (frame != streamSourceFrame) {
+      takeStreamSource();
+      streamSourceFrame = frame;
+    }
+    encodeSlice(slot, slice);
+    streamHeld[slot] = held;
+
+    /* Too late if the DMA had already started on the slot. */
+    const uintptr_t now = reinterpret_cast<uintptr_t>(dmaChannel.TCD->SADDR) - ring - slot * sliceBytes;
+    if (now && now < sliceBytes) ++streamUnderruns;
+  }
+
+  const uint32_t cycles = ARM_DWT_CYCCNT - start;
+  if (cycles > streamMaxCycles) streamMaxCycles = cycles;
+  
+  if (frameEnded) endFrame();
+  __asm__ volatile ("DSB");
+}
+
+unsigned PixelDriver::streamOrdinal() {
+  /* The slice the DMA reads, or streamSlices between frames. Every pass */
+  /* has its own TCD, so the one linked next tells which pass runs, and the */
+  /* major loop count how far it got. Read again if the DMA moved on to the */
+  /* next TCD meanwhile. */
+  const uintptr_t first = reinterpret_cast<uintptr_t>(dmasDataSegments[0].TCD);
+  uintptr_t next;
+  uint16_t citer, biter;
+  do {
+    next = dmaChannel.TCD->DLASTSGA;
+    citer = dmaChannel.TCD->CITER;
+    biter = dmaChannel.TCD->BITER;
+  } while (uintptr_t(dmaChannel.TCD->DLASTSGA) != next);
+  
+  unsigned pass = streamPasses - 1;
+  if (next != reinterpret_cast<uintptr_t>(dmasSetZeros.TCD)) {
+    const size_t j = (next - first) / sizeof(DMASetting);
+    if (! j || j >= streamPasses || reinterpret_cast<uintptr_t>(dmasDataSegments[j].TCD) != next) return streamSlices;
+    pass = j - 1;
+  }
+  const unsigned slice = 2 * pass + ((citer <= biter / 2) ? 1 : 0);
+  return (slice < streamSlices) ? slice : streamSlices - 1; /* a last pass of one slice */
+}
+
+void PixelDriver::encodeSlice(unsigned slot, unsigned slice) {
+  const unsigned bits = streamBits();
+  const size_t stride = strideOf(bits);
+  volatile uint8_t *buffer = ip->bptr + slot * streamSlicePixels * stride;
+  unsigned pixelIndex = slice * streamSlicePixels;
+  uint32_t planes[32];
+  Color colors[32u * StreamCallbackRows];
+  const Color *row = colors;
+  unsigned rows = 0; /* left in colors */
+
+  /* The last slice of the frame is padded with black. */
+  for (unsigned i = 0; i < streamSlicePixels; ++i, ++pixelIndex) {
+    if (streamSource && pixelIndex < ip->pxls) {
+      loadPlanes(planes, streamSource, pixelIndex);
+      transpose32(planes);
+    } else if (streamCallback && pixelIndex < ip->pxls) {
+      /* Ask for as many pixel indices as fit, up to the end of the slice. */
+      if (! rows) {
+        rows = streamSlicePixels - i;
+        if (rows > ip->pxls - pixelIndex) rows = ip->pxls - pixelIndex;
+        if (rows > StreamCallbackRows) rows = StreamCallbackRows;
+        streamCallback(pixelIndex, rows, colors, streamContext);
+        row = colors;
+      }
+      loadPlanes(planes, row, ip->chs);
+      transpose32(planes);
+      row += 32;
+      --rows;
+    } else {
+      memset(planes, 0, sizeof(planes));
+    }
+    writePlanes(buffer + i * stride, ip->chs, planes, bits, ~0u);
+  }
+  
+  if (flushRequired) {
+    arm_dcache_flush((uint8_t*)buffer, streamSlicePixels * stride);
+  } else {
+    __asm__ volatile ("DSB");
+  }
+}
+
+uint32_t PixelDriver::encodeCycles(const CompactStore *store) {
+  /* Times encoding the pixel indices of the first slice from the store, or */
+  /* the bit planes alone for a callback, over and over to a scratch pixel. */
+  uint32_t planes[32];
+  uint32_t scratch[32];
+  const Color black[32] = { };
+  const uint32_t start = ARM_DWT_CYCCNT;
+  for (unsigned i = 0; i < streamSlicePixels; ++i) {
+    if (store) loadPlanes(planes, store, i);
+    else loadPlanes(planes, black, ip->chs);
+    transpose32(planes);
+    writePlanes(reinterpret_cast<volatile uint8_t*>(scratch), ip->chs, planes, streamBits(), ~0u);
+  }
+  return ARM_DWT_CYCCNT - start;
+}
+
+bool PixelDriver::streamBudgetMet(const CompactStore *store, uint32_t resetBits) {
+  /* A slice is encoded while the DMA sends the other slot, but with an odd */
+  /* number of slices the first slot is sent again right after the reset */
+  /* gap, so it is encoded within the gap. A quarter more covers the cache */
+  /* flush. Only interrupts of higher priority, or disabled, can hold it up. */
+  uint32_t bitTimes = streamSlicePixels * streamBits();
+  if ((streamSlices & 1) && resetBits < bitTimes) bitTimes = resetBits;
+  const uint64_t available = uint64_t(bitTimes) * timing.bitPeriod * (F_CPU_ACTUAL / 1000000u) / 1000u;
+  return uint64_t(encodeCycles(store)) * 5 / 4 + StreamInterruptCycles <= available;
+}
+
+bool PixelDriver::setStreamSource(CompactStore &store) {
+  if (ip->bm != STREAMING) return false;
+  if (store.pxls < ip->pxls || store.chs != ip->chs || ! store.bptr) return false;
+  if (pFlex && ! streamBudgetMet(&store, resetBitTimes)) return false;
+  __disable_irq();
+  pendingSource = &store;
+  pendingCallback = nullptr;
+  pendingContext = nullptr;
+  sourcePending = true;
+  __enable_irq();
+  return true;
+}
+
+bool PixelDriver::setStreamCallback(StreamCallback callback, void *context) {
+  if (ip->bm != STREAMING || ! callback) return false;
+  __disable_irq();
+  pendingSource = nullptr;
+  pendingCallback = callback;
+  pendingContext = context;
+  sourcePending = true;
+  __enable_irq();
+  return true;
+}
+
+void PixelDriver::setDataSegments(volatile uint8_t *buffer, size_t bytes) {
+  /* Only as many segments as the bytes need, the last one linking on to */
+  /* the reset period. */
+  const size_t wsz = ip->chs / 8u;
+  size_t remaining = bytes / wsz;
+  segmentBytes = bytes;
+  const unsigned used = (remaining + MaxDMAIterationsPerTCD - 1) / MaxDMAIterationsPerTCD;
+  for (unsigned i = 0; i < used; ++i) {
+    size_t sz = (remaining >= MaxDMAIterationsPerTCD) ? MaxDMAIterationsPerTCD : remaining;
+    setDataTransfer(dmasDataSegments[i], buffer, sz * wsz);
+    if (i + 1 < used) dmasDataSegments[i].replaceSettingsOnCompletion(dmasDataSegments[i+1]);
+    buffer += MaxDMAIterationsPerTCD * wsz;
+    remaining -= sz;
+  }
+  dmasDataSegments[used-1].replaceSettingsOnCompletion(dmasSetZeros);
+  flushSegments();
+}
+
+void PixelDriver::updateSegments(volatile uint8_t *buffer) {
+  /* The DMA isn't reading the data segments, so rebuild them if the */
+  /* active pixel count has changed. */
+  if (lengthPending) {
+    lengthPending = false;
+    setDataSegments(buffer, activeBytes());
+  } else {
+    setSegmentsSource(buffer);
+  }
+}
+
+void PixelDriver::prepareSegments(volatile uint8_t *buffer) {
+  /* Single refresh modes: the dirty map still holds the changes since the */
+  /* LEDs were last sent this frame, retained mode provided. */
+  size_t bytes = activeBytes();
+  if (truncating && (ip->bm == SINGLE_BUFFER || retained)) bytes = dirtyExtent(buffer, bytes);
+  if (lengthPending || bytes != segmentBytes) {
+    lengthPending = false;
+    setDataSegments(buffer, bytes);
+  } else {
+    setSegmentsSource(buffer);
+  }
+}
+
+size_t PixelDriver::dirtyExtent(volatile const uint8_t *buffer, size_t limit) {
+  /* Up to the end of the highest dirty block, in whole pixels; at least */
+  /* one pixel so that a frame is still sent. */
+  const uint32_t *map = dirtyMapOf(buffer);
+  const size_t stride = pixelStride();
+  for (unsigned w = DirtyMapWords; w--; ) {
+    if (! map[w]) continue;
+    const size_t blocks = w * 32 + 32 - __builtin_clz(map[w]);
+    const size_t bytes = ((blocks << dirtyBlockShift) + stride - 1) / stride * stride;
+    return (bytes < limit) ? bytes : limit;
+  }
+  return stride;
+}
+
+size_t PixelDriver::activeBytes() {
+  /* A QUADCOLOR buffer without GRBW channels only uses its first 24 bit */
+  /* planes per pixel, so nothing beyond them is sent. */
+  return size_t(activePixels) * pixelStride();
+}
+
+bool PixelDriver::setActivePixelCount(uint16_t count) {
+  if (ip->bm == STREAMING || ! count || count > ip->pxls) return false;
+  activePixels = count;
+  __asm__ volatile ("DMB" ::: "memory");
+  lengthPending = pFlex != nullptr;
+  return true;
+}
+
+void PixelDriver::setSegmentsSource(volatile uint8_t *buffer) {
+  const size_t step = MaxDMAIterationsPerTCD * (ip->chs / 8u);
+  for (unsigned i = 0; i < dmasDataSegmentsCount; ++i) {
+    dmasDataSegments[i].TCD->SADDR = buffer;
+    buffer += step;
+  }
+  flushSegments();
+}
+
+bool PixelDriver::allocateSegments(unsigned count) {
+  releaseSegments();
+  if (! count) return false;
+  
+  if (count > EmbeddedDataSegments) {
+    /* From the heap, never the DTCM pools, which are stacks kept for the */
+    /* pixel buffers and couldn't take the TCDs back once allocated from */
+    /* after begin(). The DMA engine fetches the TCDs itself, so they are */
+    /* flushed, see flushSegments(). */
+    void *m = allocatePixelMemory(count * sizeof(DMASetting), OCRAM_MEMORY);
+    if (! m) return false;
+    dmasDataSegments = static_cast<DMASetting*>(m);
+    for (unsigned i = 0; i < count; ++i) new (&dmasDataSegments[i]) DMASetting();
+  }
+  dmasDataSegmentsCount = count;
+  return true;
+}
+
+void PixelDriver::releaseSegments() {
+  if (dmasDataSegments != dmasEmbeddedSegments) freePixelMemory(dmasDataSegments);
+  dmasDataSegments = dmasEmbeddedSegments;
+  dmasDataSegmentsCount = 0;
+}
+
+void PixelDriver::flushSegments() {
+  if (dmasDataSegments != dmasEmbeddedSegments && pixelMemoryNeedsFlush(dmasDataSegments)) {
+    arm_dcache_flush(dmasDataSegments, dmasDataSegmentsCount * sizeof(DMASetting));
+  }
+}
+
+void PixelDriver::flushCache(volatile uint8_t *buffer) {
+  if (flushRequired && dirtyTracking) {
+    flushDirty(buffer);
+  } else if (flushRequired) {
+    arm_dcache_flush((uint8_t*)buffer, ip->bsz);
+  } else {
+    __asm__ volatile ("DSB");
+    __asm__ volatile ("ISB");
+  }
+  if (uint32_t *map = dirtyMapOf(buffer)) memset(map, 0, sizeof(*dirtyMaps));
+}
+
+void PixelDriver::flushDirty(volatile uint8_t *buffer) {
+  /* Flush runs of consecutive dirty blocks in one go. */
+  uint8_t *b = (uint8_t*)buffer;
+  forEachDirtyRun(dirtyMapOf(buffer), getDirtyBlockCount(), dirtyBlockShift, ip->bsz,
+    [b](size_t offset, size_t length) { arm_dcache_flush(b + offset, length); });
+  __asm__ volatile ("DSB");
+  __asm__ volatile ("ISB");
+}
+
+void PixelDriver::retainFrame() {
+  /* Copy the blocks changed in the frame just flipped to the inactive */
+  /* buffer, which holds the frame before it, and write them back to memory */
+  /* right away as they are not marked dirty. */
+  uint8_t *from = (uint8_t*)activeBuffer;
+  uint8_t *to = (uint8_t*)inactiveBuffer;
+  const bool flush = flushRequired;
+  forEachDirtyRun(retainMap, getDirtyBlockCount(), dirtyBlockShift, ip->bsz,
+    [from, to, flush](size_t offset, size_t length) {
+      memcpy(to + offset, from + offset, length);
+      if (flush) arm_dcache_flush(to + offset, length);
+    });
+  __asm__ volatile ("DSB");
+  retainPending = false;
+}
+
+void PixelDriver::retainIfDue() {
+  /* The inactive buffer is sent until the ISR takes the swap, and the */
+  /* catch-up would overwrite anything drawn into it before, so wait. */
+  if (! retainPending) return;
+  while (swapRequested) {
+    if (sleepWhileWaiting) __asm__ volatile ("WFI");
+  }
+  retainFrame();
+}
+
 void PixelDriver::configurePins(bool enable) {
   uint8_t pm = enable ? OUTPUT : INPUT;
   uint32_t pc = enable
@@ -153,14 +1086,24 @@ void PixelDriver::configurePins(bool enable) {
     : (IOMUXC_PAD_PKE | IOMUXC_PAD_SPEED(2) | IOMUXC_PAD_DSE(6));
 
   /* Basic pin setup */
-  pinMode(flexPins.SRCLK, pm);
-  pinMode(flexPins.RCLK, pm);
-  pinMode(flexPins.SER, pm);
+  if (! direct()) {
+    pinMode(flexPins.SRCLK, pm);
+    pinMode(flexPins.RCLK, pm);
+  }
+  for (unsigned i = 0; i < dataPins(); ++i) pinMode(dataPin(i), pm);
 
   /* High speed and drive strength configuration */
-  *portControlRegister(flexPins.SRCLK) = pc;
-  *portControlRegister(flexPins.RCLK) = pc;
-  *portControlRegister(flexPins.SER) = pc;
+  if (! direct()) {
+    *portControlRegister(flexPins.SRCLK) = pc;
+    *portControlRegister(flexPins.RCLK) = pc;
+  }
+  for (unsigned i = 0; i < dataPins(); ++i) *portControlRegister(dataPin(i)) = pc;
+}
+
+uint8_t PixelDriver::dataPin(unsigned index) {
+  /* Lanes, or directly driven channels, use consecutive FlexIO pins from SER's on. */
+  if (! index) return flexPins.SER;
+  return pFlex->mapFlexPinToIOPin(pFlex->mapIOPinToFlexPin(flexPins.SER) + index);
 }
 
 void PixelDriver::configureFlexIO(bool enable) {
@@ -172,32 +1115,41 @@ void PixelDriver::configureFlexIO(bool enable) {
 
   if (! enable) return;
 
-  /* Configure flex clock: clock=PLL5, pred=/5, podf=/1 */
+  /* Configure flex clock: clock=PLL5, pred and podf from the bit timing, */
+  /* by default pred=/5, podf=/1 */
   /* Note: The pred of 4 (/5) isn't mentioned as a possible value of the FLEXIO#_CLK_PRED */
   /* 3 bit bitfield in the RT1060 Processor Reference Manual rev1 or rev2. However, in the */
   /* rev2 manual, similar 3 bit bitfields do show the value and indicate the corresponding */
   /* divider. It works, so no worries. */
   /* So the input clock of 768MHz is divided by 5 to get 153.6MHz */
-  pFlex->setClockSettings(2, 4, 0);
+  pFlex->setClockSettings(2, timing.flexPred - 1, timing.flexPodf - 1);
   
   /* Set up the pin mux */
-  pFlex->setIOPinToFlexMode(flexPins.SRCLK);
-  pFlex->setIOPinToFlexMode(flexPins.RCLK);
-  pFlex->setIOPinToFlexMode(flexPins.SER);
+  if (! direct()) {
+    pFlex->setIOPinToFlexMode(flexPins.SRCLK);
+    pFlex->setIOPinToFlexMode(flexPins.RCLK);
+  }
+  for (unsigned i = 0; i < dataPins(); ++i) pFlex->setIOPinToFlexMode(dataPin(i));
 
-  /* Shifter configuration */
+  /* Shifter configuration: by default shifters 0, 1 and 2 form one 96 bit */
+  /* chain holding the three 32 bit phases of each pixel bit. With 16 channels */
+  /* the phases are 16 bits and fit shifters 0 and 1, with 8 channels shifter */
+  /* 0 alone. Other timings have more phases, up to 128 bits in all. With 64 */
+  /* channels each shift outputs a bit per lane, so a phase of 32 shifts takes */
+  /* two shifters: the default chain is shifters 0 -> 5. Direct drive shifts */
+  /* out a whole 8 or 16 bit phase at once, one bit per pin. */
+  const unsigned shifters = shiftersOf(timing.phases);
   p->SHIFTCTL[0] = FLEXIO_SHIFTCTL_TIMSEL(0) | FLEXIO_SHIFTCTL_TIMPOL
     | FLEXIO_SHIFTCTL_PINCFG(3)
     | FLEXIO_SHIFTCTL_PINSEL(pFlex->mapIOPinToFlexPin(flexPins.SER))
     | FLEXIO_SHIFTCTL_SMOD(2);
-  p->SHIFTCTL[1] = FLEXIO_SHIFTCTL_TIMSEL(0) | FLEXIO_SHIFTCTL_TIMPOL
-    | FLEXIO_SHIFTCTL_SMOD(2);
-  p->SHIFTCTL[2] = FLEXIO_SHIFTCTL_TIMSEL(0) | FLEXIO_SHIFTCTL_TIMPOL
-    | FLEXIO_SHIFTCTL_SMOD(2);
-
-  p->SHIFTCFG[0] = FLEXIO_SHIFTCFG_INSRC;
-  p->SHIFTCFG[1] = FLEXIO_SHIFTCFG_INSRC;
-  p->SHIFTCFG[2] = FLEXIO_SHIFTCFG_INSRC;
+  for (unsigned i = 1; i < shifters; ++i) {
+    p->SHIFTCTL[i] = FLEXIO_SHIFTCTL_TIMSEL(0) | FLEXIO_SHIFTCTL_TIMPOL
+      | FLEXIO_SHIFTCTL_SMOD(2);
+  }
+  for (unsigned i = 0; i < shifters; ++i) {
+    p->SHIFTCFG[i] = FLEXIO_SHIFTCFG_INSRC | FLEXIO_SHIFTCFG_PWIDTH(dataPins() - 1);
+  }
 
   /* Timer configuration */
   p->TIMCFG[0] = FLEXIO_TIMCFG_TIMENA(2);
@@ -213,22 +1165,37 @@ void PixelDriver::configureFlexIO(bool enable) {
     | FLEXIO_TIMCTL_TIMOD(3);
 
   /* Using 8 bit baud counter mode so the least significant byte forms the */
-  /* baud rate divider, in this case 2. So 153.6MHz / 2 = 76.8MHz, which is */
-  /* the required output frequency for SRCLK. */
-  p->TIMCMP[0] = 0x0000BF00;
+  /* baud rate divider, by default 2. So 153.6MHz / 2 = 76.8MHz, which is */
+  /* the required output frequency for SRCLK. The upper byte is the number */
+  /* of bits per pixel bit, times 2, minus 1: by default 3 phases of 32 bits. */
+  /* Narrow words keep the bit period by shifting fewer bits, more slowly: */
+  /* 16 channels: 48 bits at 153.6MHz / 4 = 38.4MHz */
+  /* 8 channels: 24 bits at 153.6MHz / 8 = 19.2MHz */
+  p->TIMCMP[0] = ((timing.phases * laneChannels() * 2u - 1) << 8) | (timing.srclkDiv - 1u);
 
   /* Using 16 bit counter mode so the whole value forms the baud rate */
-  /* divider, in this case 64. So 153.6MHz / 64 = 2.4MHz, which is the */
-  /* required frequency for RCLK. */
-  p->TIMCMP[1] = 0x0000001F;
+  /* divider, by default 64. So 153.6MHz / 64 = 2.4MHz, which is the */
+  /* required frequency for RCLK. This latches every 32, 16 or 8 SRCLK */
+  /* cycles, i.e. once per phase, whatever the word width. */
+  p->TIMCMP[1] = laneChannels() * timing.srclkDiv - 1u;
+
+  /* Direct drive: one shift per phase, at the phase rate of the shift */
+  /* register modes, and no clock or latch pins. By default 3 shifts per */
+  /* pixel bit at 153.6MHz / 64 = 2.4MHz. */
+  if (direct()) {
+    p->TIMCTL[0] = FLEXIO_TIMCTL_TRGSEL(1) | FLEXIO_TIMCTL_TRGPOL
+      | FLEXIO_TIMCTL_TRGSRC | FLEXIO_TIMCTL_TIMOD(1);
+    p->TIMCTL[1] = 0;
+    p->TIMCMP[0] = ((timing.phases * 2u - 1) << 8) | (ip->chs * timing.srclkDiv - 1u);
+  }
 
   /* Set up the values to be loaded into the shift registers at the beginning of each bit */
-  p->SHIFTBUF[0] = Zeros;
-  p->SHIFTBUFBIS[1] = Zeros;
-  p->SHIFTBUF[2] = Zeros;
+  for (unsigned i = 0; i < shifters; ++i) {
+    p->SHIFTBUF[i] = Zeros;
+  }
 
-  /* Enable DMA trigger on shifter 1 */
-  p->SHIFTSDEN |= 0x00000002;
+  /* Enable DMA trigger on the shifter receiving the data */
+  p->SHIFTSDEN |= 1 << dataShifter();
   
   /* Enable the FlexIO */
   p->CTRL = FLEXIO_CTRL_FLEXEN;
@@ -237,7 +1204,7 @@ void PixelDriver::configureFlexIO(bool enable) {
 void PixelDriver::configurePll5(bool enable) {
   /* PLL output frequency = Fref * (DIV_SELECT + NUM/DENOM) */
   /* where Fref = 24MHz */
-  /* So in this instance we have PLLout = 24 * (32 + 0/1) = 768 MHz */
+  /* So by default we have PLLout = 24 * (32 + 0/1) = 768 MHz */
   
   /* Bypass PLL first */
   CCM_ANALOG_PLL_VIDEO &= ~CCM_ANALOG_PLL_VIDEO_BYPASS_CLK_SRC(3);
@@ -248,9 +1215,10 @@ void PixelDriver::configurePll5(bool enable) {
 
   if (! enable) return;
 
-  /* DIV: 32 */
+  /* DIV: from the bit timing, by default 32 */
+  pllDiv = timing.pllDiv;
   CCM_ANALOG_PLL_VIDEO &= ~CCM_ANALOG_PLL_VIDEO_DIV_SELECT(127);
-  CCM_ANALOG_PLL_VIDEO |= CCM_ANALOG_PLL_VIDEO_DIV_SELECT(32);
+  CCM_ANALOG_PLL_VIDEO |= CCM_ANALOG_PLL_VIDEO_DIV_SELECT(pllDiv);
 
   /* NUM/DENOM: 0 */
   CCM_ANALOG_PLL_VIDEO_NUM = 0;
@@ -276,9 +1244,13 @@ void PixelDriver::configurePll5(bool enable) {
 }
 
 void PixelDriver::configureDma(bool enable) {
-  IMXRT_FLEXIO_t *p = &pFlex->port();
   const FlexIOHandler::FLEXIO_Hardware_t *hw = &pFlex->hardware();
   dmaChannel.disable();
+  if (idling) {
+    idling = false;
+    idleMicros += micros() - idleSince;
+  }
+  unchangedFrames = 0;
 
   if (! enable) {
     dmaChannel.detachInterrupt();
@@ -289,117 +1261,979 @@ void PixelDriver::configureDma(bool enable) {
   /* it, particularly for non-continuous refresh modes, sporadically an extra */
   /* pixel bit precedes the correct buffer and messes up the output. It would */
   /* be nice to understand why...? */
-  dmasPresetZeros.sourceBuffer(&Zeros,4);
-  dmasPresetZeros.destination(p->SHIFTBUFBIS[1]);
+  setPresetZeros(dmasPresetZeros);
   dmasPresetZeros.replaceSettingsOnCompletion(dmasSetOnes);
 
-  /* This TCD signifies the end of the pixel reset period: it sets shifter 0 */
-  /* to ones and thus enables the high part of each following pixel bit. */
-  dmasSetOnes.sourceBuffer(&Ones,4);
-  dmasSetOnes.destination(p->SHIFTBUF[0]);
+  /* This TCD signifies the end of the pixel reset period: it sets the ones */
+  /* phases (by default shifter 0) to ones and thus enables the high part of */
+  /* each following pixel bit. */
+  setOnes(dmasSetOnes);
   dmasSetOnes.replaceSettingsOnCompletion(dmasDataSegments[0]);
 
   /* These TCDs are responsible for the bulk of the data transfer: they steer */
-  /* pixel data from the frame buffer to shifter 1. Since there is a limit */
+  /* pixel data from the frame buffer to the data shifter. Since there is a limit */
   /* imposed on the number of transfers per TCD, these TCDs are chained to */
   /* allow for maximum pixel strip length. */
-  volatile uint32_t *bptr = activeBuffer;
-  size_t remaining = ip->bsz / sizeof(uint32_t);
-  for (unsigned i = 0; i < dmasDataSegmentsCount; ++i) {
-    size_t sz = (remaining >= MaxDMAIterationsPerTCD) ? MaxDMAIterationsPerTCD : remaining;
-    dmasDataSegments[i].sourceBuffer(bptr, sz * sizeof(uint32_t));
-    dmasDataSegments[i].destination(p->SHIFTBUFBIS[1]);
-    dmasDataSegments[i].replaceSettingsOnCompletion(dmasDataSegments[i+1]);
-    bptr += MaxDMAIterationsPerTCD;
-    remaining -= sz;
+  /* In STREAMING mode they read passes over the ring instead. */
+  if (ip->bm == STREAMING) {
+    configureStream();
+  } else {
+    lengthPending = false;
+    setDataSegments(activeBuffer, activeBytes());
   }
-  dmasDataSegments[dmasDataSegmentsCount-1].replaceSettingsOnCompletion(dmasSetZeros);
 
-  /* This TCD is a precursor to the pixel reset period: it sets shifter 0 */
-  /* to zero and thus disables the high part of each pixel bit that follows. */
-  dmasSetZeros.sourceBuffer(&Zeros,4);
-  dmasSetZeros.destination(p->SHIFTBUF[0]);
+  /* This TCD is a precursor to the pixel reset period: it sets the ones */
+  /* phases to zero and thus disables the high part of each pixel bit that follows. */
+  setZeros(dmasSetZeros);
   dmasSetZeros.replaceSettingsOnCompletion(dmasLoopZeros);
 
-  /* This TCD is responsible for the pixel reset delay: it sends a buffer */
-  /* of zeros in a loop to shifter 1 (instead of pixel data) and requires */
-  /* a manual configuration of the TCD. */
-  DMABaseClass::TCD_t *tcd = dmasLoopZeros.TCD;
-  tcd->SADDR = &Zeros;
-  tcd->SOFF = 0;
-  tcd->ATTR_SRC = 2;
-  tcd->NBYTES = 4;
-  tcd->SLAST = -4;
-  tcd->BITER = BitTimesPerResetTime;
-  tcd->CITER = BitTimesPerResetTime;
-  dmasLoopZeros.destination(p->SHIFTBUF[1]);
+  /* This TCD is responsible for the pixel reset delay. */
+  loopZeros(dmasLoopZeros, resetBitTimes);
 
   /* Configure FlexIO module to trigger DMA. */
   dmaChannel = dmasPresetZeros;
-  dmaChannel.triggerAtHardwareEvent(hw->shifters_dma_channel[1]);
+  dmaChannel.triggerAtHardwareEvent(hw->shifters_dma_channel[dataShifter()]);
   
-  if (ip->bm == DOUBLE_BUFFER_CONTINUOUS) {
+  if (ip->bm == STREAMING) {
+    /* Continuously refreshing the pixels so loop the TCDs. */
+    dmasLoopZeros.replaceSettingsOnCompletion(dmasPresetZeros);
+    /* Interrupt for slice encoding. */
+    dmaChannel.attachInterrupt(dmaISRs[flexIOModule], StreamInterruptPriority);
+    dmaChannel.enable();
+  } else if (ip->bm == QUEUED_CONTINUOUS) {
+    /* Continuously refreshing the pixels so loop the TCDs. */
+    dmasLoopZeros.replaceSettingsOnCompletion(dmasPresetZeros);
+    /* Interrupt every frame to present the next queued buffer. */
+    dmasSetZeros.interruptAtCompletion();
+    dmaChannel.attachInterrupt(dmaISRs[flexIOModule]);
+    dmaChannel.enable();
+  } else if (ip->bm == DOUBLE_BUFFER_CONTINUOUS) {
     /* Continuously refreshing the pixels so loop the TCDs. */
     dmasLoopZeros.replaceSettingsOnCompletion(dmasPresetZeros);
-    /* Interrupt for pixel buffer switching. */
+    /* Interrupt every frame for pixel buffer switching and vblank events. */
+    dmasSetZeros.interruptAtCompletion();
     dmaChannel.attachInterrupt(dmaISRs[flexIOModule]);
     dmaChannel.enable();
   } else {
     dmasLoopZeros.disableOnCompletion();
+    /* Interrupt at the end of the frame for the frame callback, which also */
+    /* wakes the CPU from WFI. */
+    dmasLoopZeros.interruptAtCompletion();
+    dmaChannel.attachInterrupt(dmaISRs[flexIOModule]);
   }
 }
 
-void PixelDriver::flipBuffers(void) {
-  volatile uint32_t *bptr;
-  if (! pFlex) return;
+void PixelDriver::configureStream() {
+  /* The frame is sent in passes over the ring of two slices, each pass */
+  /* with a TCD of its own so that the DMA position tells the slice being */
+  /* sent. Each pass interrupts halfway and on completion, so the slice */
+  /* just sent can be encoded again two slices ahead. With an odd number of */
+  /* slices the last pass only sends the first slot. */
+  const size_t sliceBytes = streamSlicePixels * strideOf(streamBits());
+  for (unsigned pass = 0; pass < streamPasses; ++pass) {
+    DMASetting &d = dmasDataSegments[pass];
+    const bool single = 2 * pass + 1 == streamSlices;
+    setDataTransfer(d, ip->bptr, single ? sliceBytes : 2 * sliceBytes);
+    d.TCD->CSR = 0;
+    d.interruptAtCompletion();
+    if (! single) d.interruptAtHalf();
+    if (pass + 1 < streamPasses) d.replaceSettingsOnCompletion(dmasDataSegments[pass + 1]);
+    else d.replaceSettingsOnCompletion(dmasSetZeros);
+  }
+  flushSegments();
+
+  /* Encode the first two slices of frame 0 before the DMA starts, which is */
+  /* between frames for streamIsr(). */
+  streamSeen = streamSlices;
+  streamFrame = ~0u;
+  streamSourceFrame = 0;
+  takeStreamSource();
+  encodeSlice(0, 0);
+  streamHeld[0] = 0;
+  streamHeld[1] = ~0u;
+  if (streamSlices > 1) {
+    encodeSlice(1, 1);
+    streamHeld[1] = 1;
+  }
+}
+
+void PixelDriver::setPresetZeros(DMASetting &d) {
+  setDataTransfer(d, reinterpret_cast<volatile uint8_t*>(const_cast<uint32_t*>(LaneZeros)), ip->chs / 8u);
+}
+
+void PixelDriver::setOnes(DMASetting &d) {
+  /* Clocked LEDs: the start frame instead, 32 zero bits. */
+  if (clocked()) {
+    setClockFrame(d, 32);
+    return;
+  }
+  
+  /* Phase k is sent from bits (k % phasesPerShifter()) * channels upwards */
+  /* of shifter k / phasesPerShifter(). Narrow words keep the ones phases, */
+  /* the data and zeros phases in one shifter. */
+  /* With lanes, each ones phase fills whole shifters. */
+  const unsigned r = phasesPerShifter();
+  const uint32_t phaseOnes = (ip->chs >= 32) ? ~0u : (1u << ip->chs) - 1;
+  for (unsigned i = 0; i < onesShifters(); ++i) {
+    onesPatterns[i] = (lanes() > 1) ? ~0u : 0;
+    for (unsigned k = i * r; lanes() == 1 && k < (i + 1) * r && k < timing.onesPhases; ++k) {
+      onesPatterns[i] |= phaseOnes << ((k % r) * ip->chs);
+    }
+  }
+  if (pixelMemoryNeedsFlush(onesPatterns)) arm_dcache_flush(onesPatterns, sizeof(onesPatterns));
+  setShifterWords(d, onesPatterns, 4);
+}
+
+void PixelDriver::setZeros(DMASetting &d) {
+  /* Clocked LEDs: the end frame instead, zero bits for the data to ripple */
+  /* through the strip, half a bit per pixel, and for the SK9822 to latch. */
+  if (clocked()) {
+    setClockFrame(d, 32 + (ip->pxls + 1) / 2);
+    return;
+  }
+  setShifterWords(d, &Zeros, 0);
+}
+
+void PixelDriver::setClockFrame(DMASetting &d, uint16_t bits) {
+  /* Sends the clock pattern once per bit, with the data outputs low and */
+  /* the clock outputs low then high. Narrow words hold both phases, the */
+  /* first in the upper half, so a single word with the clock low there. */
+  clockPatterns[0] = (ip->chs < 64) ? clockOutputs : 0;
+  clockPatterns[1] = clockOutputs;
+  if (pixelMemoryNeedsFlush(clockPatterns)) arm_dcache_flush(clockPatterns, sizeof(clockPatterns));
+  if (ip->chs < 64) {
+    setDataTransfer(d, reinterpret_cast<volatile uint8_t*>(clockPatterns), ip->chs / 8u);
+    d.TCD->SOFF = 0;
+    d.TCD->SLAST = 0;
+    d.TCD->BITER = d.TCD->CITER = bits;
+    return;
+  }
+  DMABaseClass::TCD_t *tcd = d.TCD;
+  d.destination(pFlex->port().SHIFTBUFBIS[dataShifter()]);
+  tcd->SADDR = clockPatterns;
+  tcd->SOFF = 4;
+  tcd->ATTR_SRC = 2;
+  tcd->NBYTES = DMA_TCD_NBYTES_SMLOE | DMA_TCD_NBYTES_DMLOE
+    | DMA_TCD_NBYTES_MLOFFYES_MLOFF(-8) | DMA_TCD_NBYTES_MLOFFYES_NBYTES(8);
+  tcd->DOFF = 4;
+  tcd->SLAST = 0;
+  tcd->BITER = bits;
+  tcd->CITER = bits;
+}
+
+void PixelDriver::setClockBits(volatile uint8_t *buffer) {
+  /* The second phase of each bit plane has the clock outputs high: the */
+  /* second word with 64 channels, the lower half of a narrow word. */
+  switch (ip->chs) {
+    case 8:
+      for (size_t i = 0; i < ip->bsz; ++i) buffer[i] |= clockOutputs;
+      break;
+    case 16: {
+      volatile uint16_t *w = reinterpret_cast<volatile uint16_t*>(buffer);
+      for (size_t i = 0; i < ip->bsz / 2; ++i) w[i] |= clockOutputs;
+      break;
+    }
+    case 32: {
+      volatile uint32_t *w = reinterpret_cast<volatile uint32_t*>(buffer);
+      for (size_t i = 0; i < ip->bsz / 4; ++i) w[i] |= clockOutputs;
+      break;
+    }
+    default: {
+      volatile uint32_t *w = reinterpret_cast<volatile uint32_t*>(buffer);
+      for (size_t i = 1; i < ip->bsz / 4; i += 2) w[i] |= clockOutputs;
+      break;
+    }
+  }
+}
+
+void PixelDriver::setShifterWords(DMASetting &d, const uint32_t *source, int16_t sourceStep) {
+  /* Writes the ones shifters in one go, once, and requires a manual */
+  /* configuration of the TCD. */
+  DMABaseClass::TCD_t *tcd = d.TCD;
+  const unsigned count = onesShifters();
+  tcd->SADDR = source;
+  tcd->SOFF = sourceStep;
+  tcd->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);
+  tcd->NBYTES = 4 * count;
+  tcd->SLAST = 0;
+  tcd->DADDR = &pFlex->port().SHIFTBUF[0];
+  tcd->DOFF = 4;
+  tcd->CITER = 1;
+  tcd->BITER = 1;
+}
+
+void PixelDriver::loopZeros(DMASetting &d, uint16_t bitTimes) {
+  /* Sends a buffer of zeros in a loop to the data shifter (instead of pixel */
+  /* data), one per bit time, and requires a manual configuration of the TCD. */
+  DMABaseClass::TCD_t *tcd = d.TCD;
+  d.destination(pFlex->port().SHIFTBUF[dataShifter()]);
+  tcd->SADDR = &Zeros;
+  tcd->SOFF = 0;
+  tcd->ATTR_SRC = 2;
+  tcd->NBYTES = 4;
+  tcd->SLAST = -4;
+  tcd->BITER = bitTimes;
+  tcd->CITER = bitTimes;
+  if (dataWords() > 1) setLaneBurst(tcd);
+}
+
+void PixelDriver::setLaneBurst(DMABaseClass::TCD_t *tcd) {
+  /* Each request writes the data shifters of all lanes, then the minor */
+  /* loop offset steps back to the first one for the next pixel bit. */
+  const int32_t bytes = 4 * dataWords();
+  tcd->NBYTES = DMA_TCD_NBYTES_DMLOE | DMA_TCD_NBYTES_MLOFFYES_MLOFF(-bytes)
+    | DMA_TCD_NBYTES_MLOFFYES_NBYTES(bytes);
+  tcd->DOFF = 4;
+}
+
+static inline void linkSequenceTcd(DMASetting &d, const DMASetting &next) {
+  /* Like replaceSettingsOnCompletion(), but a single CSR store that also */
+  /* drops the DREQ a stopped sequence leaves on its last TCD. */
+  d.TCD->DLASTSGA = (int32_t)(uintptr_t)next.TCD;
+  d.TCD->CSR = DMA_TCD_CSR_ESG;
+}
+
+bool PixelDriver::buildSequence(SequenceStore &store, const SequenceFrame *frames, unsigned count) {
+  if (! pFlex || ! count || ! frames) return false;
+  if (&store == playingSequence || sequenceActive(store)) return false; /* still read by the DMA */
+  
+  const size_t wsz = ip->chs / 8u;
+  const uint32_t words = activeBytes() / wsz;
+  const unsigned segments = (words + MaxDMAIterationsPerTCD - 1) / MaxDMAIterationsPerTCD;
+  
+  /* One TCD to preset the data shifter, then per frame: set ones, the data */
+  /* segments, set zeros and as many zeros loops as the reset gap and the */
+  /* hold for the repeats need. A repeat resends an identical frame, which */
+  /* shows nothing new, so it is sent as zeros for the same time instead. */
+  DMASetting *d = store.tcds;
+  DMASetting * const end = store.tcds + store.capacity;
+  if (d == end) return false;
+  setPresetZeros(*d);
+  linkSequenceTcd(*d, *(d + 1));
+  ++d;
+  
+  for (unsigned f = 0; f < count; ++f) {
+    const SequenceFrame &sf = frames[f];
+    if (! sf.frame || sf.frame->bsz != ip->bsz || ! sf.repeats) return false;
+    const uint32_t gap = sf.resetUs ? bitTimesOf(sf.resetUs) : resetBitTimes;
+    uint64_t zeros = gap + uint64_t(sf.repeats - 1u) * (words + 2 + gap);
+    const unsigned loops = (zeros + MaxDMAIterationsPerTCD - 1) / MaxDMAIterationsPerTCD;
+    if (unsigned(end - d) < 2 + segments + loops) return false;
+
+    setOnes(*d);
+    linkSequenceTcd(*d, *(d + 1));
+    ++d;
+    volatile uint8_t *bptr = const_cast<uint8_t*>(sf.frame->bptr);
+    uint32_t remaining = words;
+    for (unsigned i = 0; i < segments; ++i, ++d) {
+      const uint32_t sz = (remaining >= MaxDMAIterationsPerTCD) ? MaxDMAIterationsPerTCD : remaining;
+      setDataTransfer(*d, bptr, sz * wsz);
+      linkSequenceTcd(*d, *(d + 1));
+      bptr += sz * wsz;
+      remaining -= sz;
+    }
+    setZeros(*d);
+    linkSequenceTcd(*d, *(d + 1));
+    ++d;
+    for (unsigned i = 0; i < loops; ++i, ++d) {
+      const uint16_t sz = (zeros >= MaxDMAIterationsPerTCD) ? MaxDMAIterationsPerTCD : zeros;
+      loopZeros(*d, sz);
+      /* The very last TCD, possibly the last of the store, closes the loop */
+      /* past the preset TCD. */
+      const bool last = f + 1 == count && i + 1 == loops;
+      linkSequenceTcd(*d, last ? store.tcds[1] : *(d + 1));
+      zeros -= sz;
+    }
+  }
+  
+  store.loopEnd = d - 1;
+  store.count = d - store.tcds;
+  if (pixelMemoryNeedsFlush(store.tcds)) arm_dcache_flush(store.tcds, store.count * sizeof(DMASetting));
+  return true;
+}
+
+bool PixelDriver::playSequence(SequenceStore &store) {
+  if (ip->bm != SINGLE_BUFFER && ip->bm != DOUBLE_BUFFER) return false;
+  if (! store.loopEnd) return false;
+  
+  if (playingSequence) {
+    /* Switch at the end of the current loop: a single link update, so the */
+    /* DMA either still loops or already goes on to the new sequence. */
+    DMASetting *last = playingSequence->loopEnd;
+    linkSequenceTcd(*last, store.tcds[1]);
+    if (pixelMemoryNeedsFlush(last)) arm_dcache_flush(last, sizeof(*last));
+  } else {
+    /* A stopped sequence may still finish its loop. */
+    waitForDma();
+    linkSequenceTcd(*store.loopEnd, store.tcds[1]);
+    if (pixelMemoryNeedsFlush(store.loopEnd)) arm_dcache_flush(store.loopEnd, sizeof(DMASetting));
+    dmaChannel = store.tcds[0];
+    dmaChannel.enable();
+  }
+  playingSequence = &store;
+  return true;
+}
+
+void PixelDriver::stopSequence() {
+  /* Finish the current loop, flipBuffers() then waits for it. */
+  if (! playingSequence) return;
+  DMASetting *last = playingSequence->loopEnd;
+  last->disableOnCompletion();
+  if (pixelMemoryNeedsFlush(last)) arm_dcache_flush(last, sizeof(*last));
+  playingSequence = nullptr;
+}
+
+bool PixelDriver::sequenceActive(const SequenceStore &store) {
+  /* The live TCD links to the next one, so the sequence is in use as long */
+  /* as that is one of its TCDs. */
+  if (! dmaEnabled(dmaChannel)) return false;
+  const uintptr_t next = dmaChannel.TCD->DLASTSGA;
+  const uintptr_t first = reinterpret_cast<uintptr_t>(store.tcds);
+  return next - first < store.count * sizeof(DMASetting);
+}
+
+bool PixelDriver::setMemoryDma(bool enable) {
+  if (enable == memDmaEnabled) return true;
+  
+  if (! enable) {
+    while (memBusy);
+    memDma.detachInterrupt();
+    memDma.release();
+    memDmaEnabled = false;
+    return true;
+  }
+  
+  if (! pFlex) return false;
+  memDma.begin();
+  if (memDma.channel >= DMA_NUM_CHANNELS) return false;
+  /* Minor loops back to back, as fast as the bus allows. */
+  memDma.triggerContinuously();
+  memDma.attachInterrupt(memoryDmaISRs[flexIOModule]);
+  memDmaEnabled = true;
+  return true;
+}
+
+bool PixelDriver::fillBuffer(volatile uint8_t *buffer, uint32_t pattern,
+    MemoryDmaCallback callback, void *context) {
+  if (memBusy) return false;
+  memPattern = pattern;
+  /* The DMA reads the pattern from memory, wherever the driver lives. */
+  if (pixelMemoryNeedsFlush(&memPattern)) arm_dcache_flush(&memPattern, sizeof(memPattern));
+  return startMemoryDma(buffer, nullptr, callback, context);
+}
+
+bool PixelDriver::copyBuffer(volatile uint8_t *to, const volatile uint8_t *from,
+    MemoryDmaCallback callback, void *context) {
+  if (! from) return false;
+  return startMemoryDma(to, from, callback, context);
+}
+
+bool PixelDriver::startMemoryDma(volatile uint8_t *to, const volatile uint8_t *from,
+    MemoryDmaCallback callback, void *context) {
+  if (! memDmaEnabled || memBusy || ! to) return false;
+  if ((reinterpret_cast<uintptr_t>(to) | reinterpret_cast<uintptr_t>(from)) & 3) return false;
+  
+  /* The source has to be in memory and the destination must not have */
+  /* cache lines that could be written back over the result later. */
+  if (from && pixelMemoryNeedsFlush((const void*)from)) arm_dcache_flush((void*)from, ip->bsz);
+  if (pixelMemoryNeedsFlush((const void*)to)) arm_dcache_flush_delete((void*)to, ip->bsz);
+  
+  /* Buffers of this driver are changed as a whole. */
+  if (to >= ip->bptr && to < ip->bptr + ip->bcnt * ip->bsz) markDirtyBytes(to, 0, ip->bsz);
+  
+  memTo = to;
+  memFrom = from;
+  memRemaining = ip->bsz;
+  memCallback = callback;
+  memContext = context;
+  memBusy = true;
+  startMemoryChunk();
+  return true;
+}
+
+void PixelDriver::startMemoryChunk() {
+  /* As many cache line sized minor loops as one major loop allows, or */
+  /* the word sized remainder in one minor loop. */
+  const size_t maxChunk = MaxDMAIterationsPerTCD * MemoryDmaMinorLoopBytes;
+  size_t chunk = (memRemaining >= maxChunk) ? maxChunk : memRemaining;
+  const size_t minor = (chunk >= MemoryDmaMinorLoopBytes) ? MemoryDmaMinorLoopBytes : chunk;
+  const uint16_t iterations = chunk / minor;
+  chunk = iterations * minor;
+  
+  DMABaseClass::TCD_t *tcd = memDma.TCD;
+  tcd->SADDR = memFrom ? (const volatile void*)memFrom : (const volatile void*)&memPattern;
+  tcd->SOFF = memFrom ? 4 : 0;
+  tcd->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);
+  tcd->NBYTES = minor;
+  tcd->SLAST = 0;
+  tcd->DADDR = memTo;
+  tcd->DOFF = 4;
+  tcd->CITER = iterations;
+  tcd->BITER = iterations;
+  tcd->DLASTSGA = 0;
+  tcd->CSR = DMA_TCD_CSR_INTMAJOR | DMA_TCD_CSR_DREQ;
   
+  memTo += chunk;
+  if (memFrom) memFrom += chunk;
+  memRemaining -= chunk;
+  memDma.enable();
+}
+
+void PixelDriver::memoryDmaIsr(void) {
+  memDma.clearInterrupt();
+  if (memRemaining) {
+    startMemoryChunk();
+  } else {
+    memBusy = false;
+    if (memCallback) memCallback(memContext);
+  }
+  __asm__ volatile ("DSB");
+}
+
+void PixelDriver::setDataTransfer(DMABaseClass &d, volatile uint8_t *source, size_t bytes) {
+  IMXRT_FLEXIO_t *p = &pFlex->port();
+  
+  /* Data goes to the bit swapped view of its shifter so it is sent MSB */
+  /* (highest channel) first. Narrow words are written to just the byte */
+  /* lane(s) of the data phase, which are in reverse order in that view. */
+  /* Direct drive sends a phase in parallel, channel n on pin n, so it */
+  /* writes the plain view instead. */
+  volatile uint8_t *bis = reinterpret_cast<volatile uint8_t*>(&p->SHIFTBUFBIS[dataShifter()]);
+  volatile uint8_t *buf = reinterpret_cast<volatile uint8_t*>(&p->SHIFTBUF[dataShifter()]);
+  const unsigned lane = timing.onesPhases % phasesPerShifter();
+  switch (ip->chs) {
+    case 8:
+      d.sourceBuffer(source, bytes);
+      d.destination(direct() ? buf[lane] : bis[3 - lane]);
+      break;
+    case 16:
+      d.sourceBuffer(reinterpret_cast<volatile uint16_t*>(source), bytes);
+      d.destination(*reinterpret_cast<volatile uint16_t*>(direct() ? buf + 2 * lane : bis + 2 * (1 - lane)));
+      break;
+    case 64:
+      /* Shifting a bit per lane out of the bit swapped view sends word 0 of */
+      /* a bit plane first, from bit 31 down, then word 1: lane 0 is sent from */
+      /* the odd bits, lane 1 from the even ones, both from channel 31 down. */
+      d.sourceBuffer(reinterpret_cast<volatile uint32_t*>(source), bytes);
+      d.destination(p->SHIFTBUFBIS[dataShifter()]);
+      /* Clocked LEDs use the same burst for the two words of a bit. */
+      setLaneBurst(d.TCD);
+      d.TCD->BITER = d.TCD->CITER = bytes / (4 * dataWords());
+      break;
+    default:
+      d.sourceBuffer(reinterpret_cast<volatile uint32_t*>(source), bytes);
+      d.destination(p->SHIFTBUFBIS[dataShifter()]);
+      break;
+  }
+}
+
+void PixelDriver::flipBuffers(void) {
+  if (! pFlex || ! stageFlip()) return;
+  __disable_irq();
+  commitFlip();
+  __enable_irq();
+  completeFlip();
+}
+
+bool PixelDriver::stageFlip() {
+  /* A flip is split into the work before it takes effect, taking effect with */
+  /* interrupts disabled and the work after, so that a DualPixelDriver can */
+  /* have the flips of both its drivers take effect at once. */
+  volatile uint8_t *bptr;
+  uint8_t slot;
   switch (ip->bm) {
     case SINGLE_BUFFER:
       /* Single refresh of display; modify pixels safely when refresh is complete. */
-      while (dmaEnabled(dmaChannel));
+      /* A sequence playing keeps the DMA busy for good, see stopSequence(). */
+      if (playingSequence) return false;
+      waitForDma();
       dmaChannel = dmasPresetZeros;
-      arm_dcache_flush((uint8_t*)activeBuffer, ip->bsz);
-      dmaChannel.enable();
-      break;
+      prepareSegments(activeBuffer);
+      flushCache(activeBuffer);
+      return true;
       
     case DOUBLE_BUFFER:
       /* Single refresh of display; modify pixels safely using inactive buffer. */
-      while (dmaEnabled(dmaChannel));
+      if (playingSequence) return false;
+      waitForDma();
       dmaChannel = dmasPresetZeros;
       bptr = inactiveBuffer;
       inactiveBuffer = activeBuffer;
       activeBuffer = bptr;
-      for (unsigned i = 0; i < dmasDataSegmentsCount; ++i) {
-        dmasDataSegments[i].TCD->SADDR = bptr;
-        bptr += MaxDMAIterationsPerTCD;
-      }
-      arm_dcache_flush((uint8_t*)activeBuffer, ip->bsz);
+      slot = inactiveSlot;
+      inactiveSlot = activeSlot;
+      activeSlot = slot;
+      prepareSegments(activeBuffer);
+      if (retained) memcpy(retainMap, dirtyMapOf(activeBuffer), sizeof(retainMap));
+      flushCache(activeBuffer);
+      return true;
+      
+    case STREAMING:
+      /* Nothing to flip, see setStreamSource(). */
+      return false;
+      
+    case QUEUED_CONTINUOUS:
+      /* Queue the rendered buffer for the ISR and go on with a free one, if any. */
+      if (! renderBufferHeld) return false;
+      flushCache(inactiveBuffer);
+      return true;
+      
+    case DOUBLE_BUFFER_CONTINUOUS:
+      /* Continual refresh of display; modify pixels safely using inactive buffer. */
+      /* The ISR may take up the swap any time, so write the buffer back first. */
+      /* A catch-up still due from the last flip, with nothing drawn since, */
+      /* is made before its map is replaced. */
+      retainIfDue();
+      if (retained) memcpy(retainMap, dirtyMapOf(inactiveBuffer), sizeof(retainMap));
+      flushCache(inactiveBuffer); /* implicit dsb isb */
+      return true;
+  }
+  return false;
+}
+
+void PixelDriver::commitFlip() {
+  volatile uint8_t *bptr;
+  uint8_t slot;
+  switch (ip->bm) {
+    case SINGLE_BUFFER:
+    case DOUBLE_BUFFER:
       dmaChannel.enable();
       break;
       
+    case QUEUED_CONTINUOUS:
+      if (shownFrame || frameRequested) setFrameRequest(nullptr);
+      readyBuffers.push(inactiveSlot);
+      renderBufferHeld = false;
+      break;
+      
     case DOUBLE_BUFFER_CONTINUOUS:
-      /* Continual refresh of display; modify pixels safely using inactive buffer. */
-      volatile uint32_t *t = activeBuffer;
+      bptr = activeBuffer;
       activeBuffer = inactiveBuffer;
-      inactiveBuffer = t;
-      arm_dcache_flush((uint8_t*)activeBuffer, ip->bsz); /* implicit dsb isb */
+      inactiveBuffer = bptr;
+      slot = activeSlot;
+      activeSlot = inactiveSlot;
+      inactiveSlot = slot;
+      retainPending = retained; /* the inactive buffer is still sent until the swap, see bufferReady() */
+
+      /* The ISR makes the swap in the frame blanking period in order to prevent tearing. */
+      swapRequested = true;
+      if (shownFrame || frameRequested) setFrameRequest(nullptr);
+      break;
+      
+    case STREAMING:
+      break;
+  }
+}
 
-      /* This sets the ISR on completion flag of the TCD and the ISR handles the rest. */
-      /* This is to synchronize the buffer swap with the frame blanking period in order to prevent tearing. */
-      dmasSetZeros.TCD->CSR |= DMA_TCD_CSR_INTMAJOR;
+void PixelDriver::completeFlip() {
+  switch (ip->bm) {
+    case DOUBLE_BUFFER:
+      /* The DMA only reads the active buffer, so catch up right away. */
+      if (retained) retainFrame();
+      break;
+      
+    case QUEUED_CONTINUOUS:
+      resumeRefresh();
+      acquireBuffer();
+      break;
+      
+    case DOUBLE_BUFFER_CONTINUOUS:
+      resumeRefresh();
+      break;
+      
+    default:
       break;
   }
 }
 
+bool PixelDriver::flipBuffersAsync(void) {
+  if (! pFlex || ! bufferReady()) return false;
+  flipBuffers();
+  return true;
+}
+
+void PixelDriver::setFrameCallback(FrameCallback callback, void *context) {
+  __disable_irq();
+  frameCallback = callback;
+  frameContext = context;
+  __enable_irq();
+}
+
+bool PixelDriver::setBitTiming(const BitTiming &bitTiming) {
+  if (! bitTiming.phases) return false;
+  if (! pFlex) {
+    timing = bitTiming;
+    return true;
+  }
+  
+  /* Running: sequences and the stream ring are laid out for the old timing. */
+  if (ip->bm == STREAMING || playingSequence || ! timingUsable(bitTiming)) return false;
+  const BitTiming previous = timing;
+  timing = bitTiming;
+  const uint32_t bitTimes = bitTimesOf(resetMicroseconds);
+  if (! bitTimes || bitTimes > MaxDMAIterationsPerTCD) {
+    timing = previous;
+    return false;
+  }
+  resetBitTimes = bitTimes;
+  
+  /* Restart the peripherals as begin() does. The restart sends activeBuffer, */
+  /* so an external frame shown or requested is let go. */
+  configureDma(false);
+  releaseFrames();
+  if (timing.pllDiv != previous.pllDiv) configurePll5(true);
+  configureFlexIO(true);
+  configureDma(true);
+  return true;
+}
+
+bool PixelDriver::timingUsable(const BitTiming &t) {
+  if (t.channels != laneChannels()) return false;
+  if (t.phases * laneChannels() > solver::MaxBitsPerPixelBit || t.onesPhases + 2 > t.phases) return false;
+  if (direct() && ip->chs * t.srclkDiv > 256) return false; /* 8 bit shift divider */
+  
+  /* FLEXIO1 has 4 shifters and FLEXIO2 8, which lanes may run out of. */
+  const unsigned shifters = (flexIOModule == FLEXIO1) ? 4 : 8;
+  if ((t.phases * lanes() + 32u / t.channels - 1) / (32u / t.channels) > shifters) return false;
+  if (! t.flexPred || ! t.flexPodf || ! t.srclkDiv || t.srclkDiv > 256) return false;
+  
+  /* A driver on the other FlexIO module keeps the PLL as it is. */
+  const unsigned others = instanceCount - (pFlex ? 1 : 0);
+  return ! others || t.pllDiv == pllDiv;
+}
+
+uint32_t PixelDriver::bitTimesOf(uint32_t microseconds) {
+  /* Rounded up to whole bit times. */
+  const uint32_t period = timing.phases ? timing.bitPeriod : defaultBitTiming(32).bitPeriod;
+  return (microseconds * 1000u + period - 1) / period;
+}
+
+bool PixelDriver::setResetInterval(uint16_t microseconds) {
+  const uint32_t bitTimes = bitTimesOf(microseconds);
+  if (! bitTimes || bitTimes > MaxDMAIterationsPerTCD) return false;
+  if (ip->bm == STREAMING && pFlex && ! streamBudgetMet(sourcePending ? pendingSource : streamSource, bitTimes)) return false;
+  resetMicroseconds = microseconds;
+  resetBitTimes = bitTimes;
+  
+  /* The DMA loads the TCD at the end of each frame, so a running refresh */
+  /* picks the new count up from the next frame on. */
+  if (pFlex) {
+    dmasLoopZeros.TCD->CITER = bitTimes;
+    dmasLoopZeros.TCD->BITER = bitTimes;
+  }
+  return true;
+}
+
+bool PixelDriver::swapPending() {
+  if (frameRequested || swapRequested) return true;
+  return readyBuffers.head != readyBuffers.tail;
+}
+
+bool PixelDriver::setIdlePolicy(uint16_t idleAfter_, uint16_t keepAliveMs) {
+  if (! pFlex) return false;
+  if (ip->bm != DOUBLE_BUFFER_CONTINUOUS && ip->bm != QUEUED_CONTINUOUS) return false;
+  keepAliveTimer.end();
+  __disable_irq();
+  idleAfter = idleAfter_;
+  unchangedFrames = 0;
+  __enable_irq();
+  if (! idleAfter) {
+    resumeRefresh();
+    return true;
+  }
+  if (! keepAliveMs) return true;
+  return keepAliveTimer.begin(keepAliveISRs[flexIOModule], keepAliveMs * 1000.0f);
+}
+
+float PixelDriver::getRefreshLoad() {
+  __disable_irq();
+  const uint32_t now = micros();
+  const uint32_t idle = idleMicros + (idling ? now - idleSince : 0);
+  const uint32_t total = now - statsSince;
+  __enable_irq();
+  if (! total || idle >= total) return total ? 0.0f : 1.0f;
+  return 1.0f - float(idle) / total;
+}
+
+void PixelDriver::resetRefreshStatistics() {
+  __disable_irq();
+  statsSince = micros();
+  idleMicros = 0;
+  if (idling) idleSince = statsSince;
+  __enable_irq();
+}
+
+bool PixelDriver::waitForVblank(uint32_t timeoutMs) {
+  if (! pFlex || ! dmaEnabled(dmaChannel)) return false;
+  const uint32_t frame = frameCount;
+  const uint32_t start = millis();
+  while (frameCount == frame) {
+    if (millis() - start >= timeoutMs) return false;
+    if (sleepWhileWaiting) __asm__ volatile ("WFI");
+  }
+  retainIfDue();
+  return true;
+}
+
+void PixelDriver::waitForDma() {
+  /* Never while a sequence plays: its chain loops and the DMA never stops. */
+  while (dmaEnabled(dmaChannel)) {
+    if (sleepWhileWaiting) __asm__ volatile ("WFI");
+  }
+}
+
 bool PixelDriver::bufferReady() {
-  return ! ((ip->bm == SINGLE_BUFFER || ip->bm == DOUBLE_BUFFER) && dmaEnabled(dmaChannel));
+  if (ip->bm == STREAMING) return ! sourcePending;
+  if (ip->bm == QUEUED_CONTINUOUS) return renderBufferHeld || acquireBuffer();
+  if (ip->bm == DOUBLE_BUFFER_CONTINUOUS) {
+    if (swapRequested) return false;
+    retainIfDue();
+    return true;
+  }
+  return ! dmaEnabled(dmaChannel);
+}
+
+void PixelDriver::setPixelRow(uint16_t pixelIndex, const Color *colors, volatile uint8_t *buffer) {
+  if (pixelIndex >= ip->pxls || ip->bm == STREAMING) return;
+  if (clocked()) {
+    setClockedRow(pixelIndex, colors, buffer);
+    return;
+  }
+  if (ip->chs == 64) {
+    setLaneRow(pixelIndex, colors, buffer);
+    return;
+  }
+
+  /* Convert the 32 colors into 32 bit planes in one go rather than bit by bit. */
+  /* Narrow modes only use the low 8 or 16 planes of each word. */
+  uint32_t planes[32];
+  loadPlanes(planes, colors, ip->chs);
+  transpose32(planes);
+
+  /* RGB and GRB channels use the first 24 planes and a 24 word stride per */
+  /* pixel; GRBW channels use all 32 planes and a 32 word stride. */
+  const uint32_t rgbChannels = ~uint32_t(quadChannels) & ((ip->chs == 32) ? ~0u : ((1u << ip->chs) - 1));
+  if (rgbChannels) {
+    const size_t stride = strideOf(24);
+    markDirtyBytes(buffer, stride * pixelIndex, stride);
+    writePlanes(buffer + stride * pixelIndex, ip->chs, planes, 24, rgbChannels);
+  }
+  if (quadChannels) {
+    const size_t stride = strideOf(32);
+    markDirtyBytes(buffer, stride * pixelIndex, stride);
+    writePlanes(buffer + stride * pixelIndex, ip->chs, planes, 32, uint32_t(quadChannels));
+  }
+}
+
+void PixelDriver::setLaneRow(uint16_t pixelIndex, const Color *colors, volatile uint8_t *buffer) {
+  /* The planes of each lane as with 32 channels, then interleaved into two */
+  /* words per plane; channel masks interleave the same way. */
+  uint32_t planes[2][32];
+  for (unsigned j = 0; j < 2; ++j) {
+    loadPlanes(planes[j], colors + 32 * j, 32);
+    transpose32(planes[j]);
+  }
+
+  const uint64_t masks[2] = { ~quadChannels, quadChannels };
+  for (unsigned m = 0; m < 2; ++m) {
+    if (! masks[m]) continue;
+    const unsigned bits = m ? 32 : 24;
+    const size_t stride = strideOf(bits);
+    const uint32_t lane0 = uint32_t(masks[m]), lane1 = uint32_t(masks[m] >> 32);
+    const uint32_t wordMasks[2] = { laneWord(lane0, lane1, 0), laneWord(lane0, lane1, 1) };
+    markDirtyBytes(buffer, stride * pixelIndex, stride);
+    volatile uint32_t *w = reinterpret_cast<volatile uint32_t*>(buffer + stride * pixelIndex);
+    for (unsigned b = 0; b < bits; ++b) {
+      for (unsigned k = 0; k < 2; ++k, ++w) {
+        const uint32_t v = laneWord(planes[0][b], planes[1][b], k);
+        *w = (wordMasks[k] == ~0u) ? v : ((*w & ~wordMasks[k]) | (v & wordMasks[k]));
+      }
+    }
+  }
+}
+
+void PixelDriver::setClockedRow(uint16_t pixelIndex, const Color *colors, volatile uint8_t *buffer) {
+  /* The 32 bit LED frames of the data outputs as planes, each written with */
+  /* the clock outputs low then high: two words with 64 channels, the upper */
+  /* then the lower half of a narrow word. */
+  const unsigned outputs = laneChannels();
+  Color frames[32];
+  for (unsigned i = 0; i < outputs; ++i) frames[i].raw = clockedValue(colors[i]);
+  uint32_t planes[32];
+  loadPlanes(planes, frames, outputs);
+  transpose32(planes);
+  
+  const size_t stride = strideOf(32);
+  markDirtyBytes(buffer, stride * pixelIndex, stride);
+  buffer += stride * pixelIndex;
+  
+  switch (ip->chs) {
+    case 8:
+      for (unsigned b = 0; b < 32; ++b) {
+        buffer[b] = uint8_t((planes[b] & ~clockOutputs) << 4 | (planes[b] | clockOutputs));
+      }
+      break;
+    case 16: {
+      volatile uint16_t *w = reinterpret_cast<volatile uint16_t*>(buffer);
+      for (unsigned b = 0; b < 32; ++b) {
+        w[b] = uint16_t((planes[b] & ~clockOutputs) << 8 | (planes[b] | clockOutputs));
+      }
+      break;
+    }
+    case 32: {
+      volatile uint32_t *w = reinterpret_cast<volatile uint32_t*>(buffer);
+      for (unsigned b = 0; b < 32; ++b) {
+        w[b] = (planes[b] & ~clockOutputs) << 16 | (planes[b] | clockOutputs);
+      }
+      break;
+    }
+    default: {
+      volatile uint32_t *w = reinterpret_cast<volatile uint32_t*>(buffer);
+      for (unsigned b = 0; b < 32; ++b) {
+        *w++ = planes[b] & ~clockOutputs;
+        *w++ = planes[b] | clockOutputs;
+      }
+      break;
+    }
+  }
+}
+
+bool PixelDriver::setClockOutputs(uint32_t clockMask) {
+  if (pFlex || ! clockMask || ! ~clockMask) return false;
+  clockOutputs = clockMask;
+  return true;
 }
 
 void PixelDriver::setChannelType(uint8_t channel, ChannelType type) {
   /* Allows the user to change each channel to RGB, GRB, or GRBW formatting */
-  if (channel >= 32) return;
+  if (channel >= ip->chs) return;
   if (type == GRBW && ip->cc != QUADCOLOR) return;
   channelTypes[channel] = type;
+  if (type == GRBW) quadChannels |= uint64_t(1) << channel;
+  else quadChannels &= ~(uint64_t(1) << channel);
+  
+  /* The first or last GRBW channel changes the pixel stride, and with it */
+  /* the frame length. */
+  __asm__ volatile ("DMB" ::: "memory");
+  lengthPending = pFlex != nullptr;
+}
+
+DualPixelDriver::DualPixelDriver(const InternalProperties* ip1, const InternalProperties* ip2)
+  : first(ip1)
+  , second(ip2)
+{
+}
+
+void DualPixelDriver::setChannelType(uint8_t channel, ChannelType type) {
+  if (channel < 32) first.setChannelType(channel, type);
+  else if (channel < 64) second.setChannelType(channel - 32, type);
+}
+
+bool DualPixelDriver::begin(FlexPins flexPins1, FlexPins flexPins2) {
+  /* Lockstep needs the same frame on both sides. */
+  const InternalProperties *a = first.ip, *b = second.ip;
+  if (a->chs != 32 || b->chs != 32) return false;
+  if (a->pxls != b->pxls || a->cc != b->cc || a->bm != b->bm || a->bm == STREAMING) return false;
+  if (! first.begin(FLEXIO1, flexPins1)) return false;
+  if (! second.begin(FLEXIO2, flexPins2)) {
+    first.end();
+    return false;
+  }
+  syncFrames();
+  return true;
+}
+
+bool DualPixelDriver::setBitTiming(const BitTiming &bitTiming) {
+  /* Never leave the two sides on different timings: check both first, and */
+  /* should the second still refuse, put the first back. */
+  if (first.pFlex && (! first.timingUsable(bitTiming) || ! second.timingUsable(bitTiming))) return false;
+  const BitTiming previous = first.timing;
+  if (! first.setBitTiming(bitTiming)) return false;
+  if (! second.setBitTiming(bitTiming)) {
+    first.setBitTiming(previous);
+    return false;
+  }
+  if (first.pFlex) syncFrames();
+  return true;
+}
+
+bool DualPixelDriver::setResetInterval(uint16_t microseconds) {
+  /* As with the bit timing, should the second side refuse, put the first back. */
+  const uint16_t previous = first.resetMicroseconds;
+  if (! first.setResetInterval(microseconds)) return false;
+  if (! second.setResetInterval(microseconds)) {
+    first.setResetInterval(previous);
+    return false;
+  }
+  return true;
+}
+
+bool DualPixelDriver::setTimingAndReset(const BitTiming &bitTiming, uint16_t resetUs) {
+  /* A chipset is set as a whole or not at all: if the reset interval is */
+  /* refused with the new timing, both sides go back to the old one. */
+  const BitTiming previous = first.timing;
+  if (! setBitTiming(bitTiming)) return false;
+  if (setResetInterval(resetUs)) return true;
+  if (first.pFlex) {
+    setBitTiming(previous);
+  } else {
+    first.timing = previous;
+    second.timing = previous;
+  }
+  return false;
+}
+
+bool DualPixelDriver::waitForVblank(uint32_t timeoutMs) {
+  /* The frames end about together, so wait for one to end on both sides */
+  /* rather than for each in turn, which could take a frame longer. */
+  if (! first.pFlex || ! dmaEnabled(first.dmaChannel) || ! dmaEnabled(second.dmaChannel)) return false;
+  const uint32_t frame1 = first.frameCount;
+  const uint32_t frame2 = second.frameCount;
+  const uint32_t start = millis();
+  while (first.frameCount == frame1 || second.frameCount == frame2) {
+    if (millis() - start >= timeoutMs) return false;
+    if (first.sleepWhileWaiting) __asm__ volatile ("WFI");
+  }
+  first.retainIfDue();
+  second.retainIfDue();
+  return true;
+}
+
+void DualPixelDriver::syncFrames() {
+  /* Continuous modes start each chain as its driver is set up: stop both */
+  /* at the end of their frames, then start them again together. Single */
+  /* refresh modes start together at every flip anyway. */
+  if (first.ip->bm != DOUBLE_BUFFER_CONTINUOUS && first.ip->bm != QUEUED_CONTINUOUS) return;
+  /* That takes up to a frame, so wait with interrupts enabled and only */
+  /* the restart in the critical section. */
+  first.dmasLoopZeros.TCD->CSR |= DMA_TCD_CSR_DREQ;
+  second.dmasLoopZeros.TCD->CSR |= DMA_TCD_CSR_DREQ;
+  while (dmaEnabled(first.dmaChannel) || dmaEnabled(second.dmaChannel)) {
+    if (first.sleepWhileWaiting) __asm__ volatile ("WFI");
+  }
+  first.dmasLoopZeros.TCD->CSR &= ~DMA_TCD_CSR_DREQ;
+  second.dmasLoopZeros.TCD->CSR &= ~DMA_TCD_CSR_DREQ;
+  
+  __disable_irq();
+  first.dmaChannel = first.dmasPresetZeros;
+  second.dmaChannel = second.dmasPresetZeros;
+  first.dmaChannel.enable();
+  second.dmaChannel.enable();
+  __enable_irq();
+}
+
+void DualPixelDriver::flipBuffers(void) {
+  /* Both flips take effect in the same critical section, so the next frame */
+  /* blanking period or DMA start picks up either both or neither. */
+  if (! first.pFlex || ! second.pFlex) return;
+  const bool flipFirst = first.stageFlip();
+  const bool flipSecond = second.stageFlip();
+  __disable_irq();
+  if (flipFirst) first.commitFlip();
+  if (flipSecond) second.commitFlip();
+  __enable_irq();
+  if (flipFirst) first.completeFlip();
+  if (flipSecond) second.completeFlip();
 }
 
 } // namespace TDWS28XX
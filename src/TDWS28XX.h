@@ -34,6 +34,7 @@ SOFTWARE.
 
 #include <Arduino.h>
 #include <DMAChannel.h>
+#include "TDWS28XXTiming.h"
 class FlexIOHandler;
 
 namespace TDWS28XX {
@@ -70,7 +71,29 @@ enum ColorCapability { TRICOLOR, QUADCOLOR }; // adding white requires additiona
 enum BufferMode {
   SINGLE_BUFFER, // update pixels only upon flushBuffer(); see bufferReady()
   DOUBLE_BUFFER, // update pixels only upon flipBuffers(); see bufferReady()
-  DOUBLE_BUFFER_CONTINUOUS // update pixels continuously but use double buffering
+  DOUBLE_BUFFER_CONTINUOUS, // update pixels continuously but use double buffering
+  QUEUED_CONTINUOUS, // update pixels continuously from a queue of 3 or more buffers; see bufferReady()
+  STREAMING // update pixels continuously, encoded on the fly from a CompactStore or callback; see StreamBuffer
+};
+
+enum QueuePolicy { // QUEUED_CONTINUOUS: which ready buffer is shown at the next frame
+  LATEST_FRAME, // the most recently submitted, older ones are dropped
+  EVERY_FRAME // the oldest submitted, one per refresh
+};
+
+enum ResetInterval { // reset (latch) gaps in microseconds, see PixelDriver::setResetInterval()
+  RESET_WS2812 = 50, // WS2811, WS2812 and WS2812B before V5
+  RESET_SK6812 = 80, // SK6812, SK6812RGBW
+  RESET_WS2812B_V5 = 280, // WS2812B V5, WS2815
+  RESET_DEFAULT = 300 // WS2813 and any of the above
+};
+
+enum MemoryPlacement {
+  DTCM_MEMORY, // RAM1: fastest for the CPU, never cached; draws from pools given to addDtcmPool()
+  OCRAM_MEMORY, // RAM2 (DMAMEM): the heap
+  PSRAM_MEMORY, // Teensy 4.1 external PSRAM (EXTMEM), if fitted
+  OCRAM_UNCACHED_MEMORY, // RAM2 made non-cacheable by the MPU: no flushes, slower pixel writes
+  OCRAM_WRITETHROUGH_MEMORY // RAM2 made write-through by the MPU: no flushes, cached reads
 };
 
 struct FlexPins {
@@ -78,6 +101,15 @@ struct FlexPins {
   uint8_t RCLK; // ... latch clock
   uint8_t SER; // ... shift data
 };
+// With 64 channels, the second 32 channel lane is shifted out on the FlexIO pin
+// after SER's, sharing SRCLK and RCLK, e.g. FLEXIO2 SER 10 -> 12, 11 -> 13, 6 -> 9.
+
+// Direct drive: the 8 or 16 channels of a narrow buffer drive the strips straight
+// from consecutive FlexIO pins, channel 0 on firstPin's, through a 5V buffer such as
+// a 74AHCT245 instead of shift registers. Only boards bringing out that many pins
+// in a row can do it, e.g. the MicroMod's FLEXIO2 pins 10, 12, 11, 13, 40 -> 45 from 10.
+const uint8_t NoPin = 0xff;
+inline FlexPins directPins(uint8_t firstPin) { return { NoPin, NoPin, firstPin }; }
 // Pins available Teensy 4.0:
 //   FLEXIO1: 2, 3, 4, 5, 33
 //   FLEXIO2: 6, 7, 8, 9, 10, 11, 12, 13, 32
@@ -88,6 +120,68 @@ struct FlexPins {
 //   FlexIO1: 2, 3, 4, 5, 33
 //   FLEXIO2: 6, 7, 8, 9, 10, 11, 12, 13, 32, 40, 41, 42, 43, 44, 45
 
+struct SceneStore // compact image: one Color per channel and pixel, pixel index major
+{
+  uint16_t pxls;
+  Color *cptr;
+
+  void set(uint8_t channel, uint16_t pixelIndex, const Color &color) {
+    if (channel > 31 || pixelIndex >= pxls) return;
+    cptr[32u * pixelIndex + channel] = color;
+  }
+  Color get(uint8_t channel, uint16_t pixelIndex) const {
+    if (channel > 31 || pixelIndex >= pxls) return Color();
+    return cptr[32u * pixelIndex + channel];
+  }
+  // all 32 channels of one pixel index, suitable for PixelDriver::setPixelRow()
+  // of up to 32 channels; 64 channel drivers read rows of 64 colors
+  Color* row(uint16_t pixelIndex) const { return cptr + 32u * pixelIndex; }
+};
+
+template<uint16_t maximumPixelsPerStrip>
+struct SceneBuffer
+{
+  operator SceneStore&() { return s; }
+  Color colors[32u * maximumPixelsPerStrip];
+  SceneStore s = { maximumPixelsPerStrip, colors };
+};
+
+struct CompactStore // compact frame for STREAMING mode: 3 or 4 bytes per channel and pixel, pixel index major
+{
+  uint16_t pxls;
+  uint8_t chs;
+  uint8_t bpc; // bytes per color: 3 drops the white byte of Color
+  uint8_t *bptr;
+
+  void set(uint8_t channel, uint16_t pixelIndex, const Color &color) {
+    if (channel >= chs || pixelIndex >= pxls) return;
+    uint8_t *b = bptr + (size_t(pixelIndex) * chs + channel) * bpc;
+    b[0] = color.raw >> 24;
+    b[1] = color.raw >> 16;
+    b[2] = color.raw >> 8;
+    if (bpc == 4) b[3] = color.raw;
+  }
+  Color get(uint8_t channel, uint16_t pixelIndex) const {
+    Color c = Color();
+    if (channel >= chs || pixelIndex >= pxls) return c;
+    const uint8_t *b = bptr + (size_t(pixelIndex) * chs + channel) * bpc;
+    c.raw = uint32_t(b[0]) << 24 | uint32_t(b[1]) << 16 | uint32_t(b[2]) << 8;
+    if (bpc == 4) c.raw |= b[3];
+    return c;
+  }
+};
+
+template<uint16_t maximumPixelsPerStrip,
+  ColorCapability colorCapability = TRICOLOR,
+  uint8_t channels = 32>
+struct CompactBuffer
+{
+  static_assert(channels == 8 || channels == 16 || channels == 32, "channels must be 8, 16 or 32");
+  operator CompactStore&() { return s; }
+  uint8_t colors[size_t(maximumPixelsPerStrip) * channels * ((colorCapability == QUADCOLOR) ? 4 : 3)];
+  CompactStore s = { maximumPixelsPerStrip, channels, (colorCapability == QUADCOLOR) ? 4 : 3, colors };
+};
+
 struct InternalProperties // internal use only
 {
   uint16_t pxls;
@@ -95,42 +189,329 @@ struct InternalProperties // internal use only
   BufferMode bm;
   size_t bsz;
   uint8_t *bptr;
+  uint8_t chs; // shift register outputs: 8, 16 or 32, the bits per buffer word; or 64 in two lanes
+  uint8_t bcnt; // buffers of bsz bytes each at bptr
 };
 
+// size in bytes of one pixel buffer, and the number of such buffers needed; the
+// size is rounded up to whole 32 byte cache lines so that every buffer of a set
+// starts on a cache line of its own
+constexpr size_t pixelBufferSize(uint16_t pixelsPerStrip, ColorCapability cc, uint8_t channels = 32) {
+  return (channels / 8u * pixelsPerStrip * ((cc == QUADCOLOR) ? 32 : 24) + 31) & ~size_t(31);
+}
+constexpr unsigned pixelBufferCount(BufferMode bm) {
+  return (bm == QUEUED_CONTINUOUS) ? 3 : (bm == DOUBLE_BUFFER_CONTINUOUS || bm == DOUBLE_BUFFER) ? 2 : 1;
+}
+const uint8_t MaxQueuedBuffers = 8;
+
+// Fewer channels store the bit planes in narrower words: 8 channels need a
+// quarter of the RAM of 32 and run the shift register clock at a quarter of the rate.
+// 64 channels drive two shift register chains of 32 at the rate of 32 channels,
+// from FLEXIO2 only, as FLEXIO1 hasn't the shifters; not for STREAMING.
+// Only QUEUED_CONTINUOUS takes a buffer count, 3 to MaxQueuedBuffers.
 template<uint16_t maximumPixelsPerStrip,
   ColorCapability colorCapability = QUADCOLOR,
-  BufferMode bufferMode = SINGLE_BUFFER>
+  BufferMode bufferMode = SINGLE_BUFFER,
+  uint8_t channels = 32,
+  uint8_t buffers = pixelBufferCount(bufferMode)>
 struct PixelBuffer
 {
+  static_assert(channels == 8 || channels == 16 || channels == 32 || channels == 64,
+    "channels must be 8, 16, 32 or 64");
+  static_assert(buffers == pixelBufferCount(bufferMode)
+    || (bufferMode == QUEUED_CONTINUOUS && buffers >= 3 && buffers <= MaxQueuedBuffers), "invalid buffer count");
   operator const InternalProperties*() const { return &p; }
-  uint8_t buffer[sizeof(uint32_t) * maximumPixelsPerStrip
-        * ((colorCapability == QUADCOLOR) ? 32 : 24)
-        * ((bufferMode == DOUBLE_BUFFER_CONTINUOUS || bufferMode == DOUBLE_BUFFER) ? 2 : 1)];
+  // cache line aligned so flushes for DMA never touch neighbouring variables
+  uint8_t buffer[pixelBufferSize(maximumPixelsPerStrip, colorCapability, channels)
+        * buffers] __attribute__((aligned(32)));
   const InternalProperties p = {
     maximumPixelsPerStrip,
     colorCapability,
     bufferMode,
-    sizeof(buffer) / ((bufferMode == DOUBLE_BUFFER_CONTINUOUS || bufferMode == DOUBLE_BUFFER) ? 2 : 1),
-    buffer
+    pixelBufferSize(maximumPixelsPerStrip, colorCapability, channels),
+    buffer,
+    channels,
+    buffers
   };
 };
 
+// Frame pre-encoded in the bit plane layout of a PixelDriver's buffers and owned
+// by the application, e.g. rendered offline into PSRAM; see PixelDriver::registerFrame().
+struct ExternalFrame
+{
+  const uint8_t *bptr; // 32 byte aligned, PixelDriver::getBufferSize() bytes
+  size_t bsz; // set by registerFrame()
+  volatile uint16_t refs; // drivers sending it or about to; modify or free it only at 0
+};
+
+// A loop of registered ExternalFrames played by the DMA alone, without interrupts;
+// see PixelDriver::buildSequence(). Each frame is shown for repeats frame times,
+// followed by a reset gap of resetUs (0 for the driver's reset interval).
+struct SequenceFrame
+{
+  ExternalFrame *frame;
+  uint16_t repeats;
+  uint16_t resetUs;
+};
+
+struct SequenceStore // internal use only, see SequenceBuffer
+{
+  DMASetting *tcds;
+  uint16_t capacity;
+  uint16_t count;
+  DMASetting *loopEnd; // links back to the start of the loop
+};
+
+// TCD storage for a sequence: 1, plus per frame 2, one per 32767 buffer words
+// and one per 32767 bit times (41mS) of reset gap and repeats.
+template<uint16_t maximumTcds>
+struct SequenceBuffer
+{
+  operator SequenceStore&() { return s; }
+  DMASetting tcds[maximumTcds];
+  SequenceStore s = { tcds, maximumTcds, 0, nullptr };
+};
+
+// Completion callback of the memory DMA, called from its interrupt.
+typedef void (*MemoryDmaCallback)(void *context);
+
+// Vertical blanking callback, called from the DMA interrupt; see setFrameCallback().
+typedef void (*FrameCallback)(void *context);
+
+// STREAMING mode callback: fill colors[32 * i + channel] for pixel indices
+// firstPixel to firstPixel + count - 1. Runs from the DMA interrupt just before
+// the pixels are sent, so it must be quick and take no locks.
+typedef void (*StreamCallback)(uint16_t firstPixel, uint16_t count, Color *colors, void *context);
+
+// Bit plane ring for STREAMING mode: two slices of slicePixels pixel indices,
+// each encoded from a CompactStore or StreamCallback by the DMA interrupt while
+// the other is sent.
+// Smaller slices need less RAM but interrupt more often, and begin() allocates
+// a DMA TCD from the heap per two slices of the strip beyond the first eight; DTCM saves
+// the cache flush per slice. With an odd number of slices per strip the first slice
+// is encoded within the reset gap, so it must be short enough for that.
+// All channels are sent with the same number of bits, so QUADCOLOR streams drive
+// GRBW strips only.
+template<uint16_t pixelsPerStrip,
+  uint16_t slicePixels,
+  ColorCapability colorCapability = TRICOLOR,
+  uint8_t channels = 32>
+struct StreamBuffer
+{
+  static_assert(channels == 8 || channels == 16 || channels == 32, "channels must be 8, 16 or 32");
+  static_assert(slicePixels && slicePixels <= pixelsPerStrip, "slicePixels must be 1 to pixelsPerStrip");
+  static_assert(2u * slicePixels * ((colorCapability == QUADCOLOR) ? 32 : 24) <= DMA_TCD_BITER_MASK,
+    "slicePixels too large for one DMA major loop");
+  operator const InternalProperties*() const { return &p; }
+  uint8_t buffer[pixelBufferSize(2 * slicePixels, colorCapability, channels)] __attribute__((aligned(32)));
+  const InternalProperties p = {
+    pixelsPerStrip,
+    colorCapability,
+    STREAMING,
+    sizeof(buffer),
+    buffer,
+    channels,
+    1
+  };
+};
+
+// Cache line aligned memory for pixel buffers; returns nullptr on failure.
+// DTCM has no heap of its own, so donate one or more static arrays first, e.g.
+//   uint8_t pool[65536] __attribute__((aligned(32))); addDtcmPool(pool, sizeof(pool));
+FLASHMEM bool addDtcmPool(void *pool, size_t size);
+// The MPU placements draw from one pool each, configured as its own MPU region.
+// Such a pool must be a power of two in size and aligned to its size, e.g.
+//   TDWS28XX_MPU_POOL(pool, 131072); addMpuPool(pool, sizeof(pool), OCRAM_UNCACHED_MEMORY);
+#define TDWS28XX_MPU_POOL(name, size) DMAMEM uint8_t name[size] __attribute__((aligned(size)))
+FLASHMEM bool addMpuPool(void *pool, size_t size, MemoryPlacement placement);
+FLASHMEM void* allocatePixelMemory(size_t size, MemoryPlacement placement);
+FLASHMEM void freePixelMemory(void *memory);
+// false if CPU writes reach memory without a cache flush (DTCM, MPU pools)
+bool pixelMemoryNeedsFlush(const void *memory);
+
+// Pixel buffer sized at run time, e.g. from a configuration file read at boot.
+// Allocate before calling PixelDriver::begin() and keep it for the driver's lifetime.
+class DynamicPixelBuffer
+{
+  public:
+    DynamicPixelBuffer() : p() { }
+    ~DynamicPixelBuffer() { release(); }
+    FLASHMEM bool allocate(uint16_t pixelsPerStrip, ColorCapability colorCapability = QUADCOLOR,
+      BufferMode bufferMode = SINGLE_BUFFER, MemoryPlacement placement = OCRAM_MEMORY,
+      uint8_t channels = 32, uint8_t buffers = 0); // returns true on success; 0 buffers for the default
+    FLASHMEM bool allocateStream(uint16_t pixelsPerStrip, uint16_t slicePixels,
+      ColorCapability colorCapability = TRICOLOR, MemoryPlacement placement = DTCM_MEMORY,
+      uint8_t channels = 32); // STREAMING ring, see StreamBuffer
+    FLASHMEM void release();
+    operator const InternalProperties*() const { return &p; }
+
+  private:
+    DynamicPixelBuffer(const DynamicPixelBuffer&) = delete;
+    DynamicPixelBuffer& operator=(const DynamicPixelBuffer&) = delete;
+    InternalProperties p;
+};
+
 class PixelDriver
 {
   public:
     FLASHMEM PixelDriver(const InternalProperties* ip_);
     FLASHMEM virtual ~PixelDriver();
-    FLASHMEM void setChannelType(uint8_t channel, ChannelType type); // channels 0 -> 31
+    FLASHMEM void setChannelType(uint8_t channel, ChannelType type); // channels 0 -> 31 (or 7, 15, 63)
+    // Buffers of more than 4 * 32767 words, and STREAMING strips of more than 8
+    // slices, need more DMA TCDs than the driver holds; begin() takes those from
+    // the heap (OCRAM), never a DTCM pool, and end() frees them.
     FLASHMEM bool begin(FlexIOModule flexIOModule = FLEXIO1, FlexPins flexPins = { 2, 3, 4 }); // returns true on success
     
+    // Bit timing, e.g. from solveBitTiming(), for the channel count of the buffer,
+    // 32 for 64 channels as each lane shifts 32, and half with clocked LEDs.
+    // Both drivers share PLL5, so they need the same pllDiv or the second begin()
+    // fails. After begin() the peripherals restart with it, cutting the frame being
+    // sent short; not while STREAMING or playing a sequence. Returns true on success.
+    bool setBitTiming(const BitTiming &bitTiming);
+    const BitTiming &getBitTiming() { return timing; } // valid after begin()
+    // Clocked LEDs (APA102, SK9822, HD107) instead of WS28XX: the outputs in
+    // clockMask carry a shared clock, the others data, from a QUADCOLOR buffer
+    // which holds each bit twice, with the clock low then high, so it drives half
+    // its channel count: 4 outputs from 8 channels, 8 from 16 and so on to 32.
+    // Fewer outputs shift faster. begin() sets the clock bits, which raw buffer
+    // writes must keep. Channels are the outputs, and setPixelRow() takes 32
+    // colors of which the first outputs are used. Each frame is sent between a
+    // start frame and an end frame of zeros. Call before begin(), which then
+    // defaults to clockedBitTiming(). Returns true on success.
+    bool setClockOutputs(uint32_t clockMask);
+    // 0 to 31, sent with every pixel written from then on
+    void setGlobalBrightness(uint8_t level) { globalBrightness = (level > 31) ? 31 : level; }
+    
+    // Sets the fastest in-spec bit timing and the reset interval of a chipset, and
+    // fails to compile if the chipset can't be driven with this many channels.
+    template<Chipset chipset, uint8_t channels = 32>
+    bool setChipset() {
+      constexpr BitTiming t = solveBitTiming(chipsetProfile(chipset), channels);
+      static_assert(t.phases, "chipset bit timing not reachable with this channel count");
+      return setBitTiming(t) && setResetInterval(chipsetProfile(chipset).resetUs);
+    }
+    
     void flipBuffers(void); // for double buffer modes
     void flushBuffer(void) { flipBuffers(); } // for single buffer mode
     
     // SINGLE_BUFFER: returns true if the flush has completed and the pixel buffer
     //    can safely be modified and the next call to flushBuffer() won't block
     // DOUBLE_BUFFER: returns true if the next call to flipBuffers() won't block
+    // DOUBLE_BUFFER_CONTINUOUS: returns true once the last flip has taken effect
+    //    at the frame blanking period and the inactive buffer is no longer displayed
+    // QUEUED_CONTINUOUS: returns true if the inactive buffer is free for rendering,
+    //    taking a free buffer if needed; flipBuffers() then queues it for display
+    //    and takes the next free buffer, if any. Neither ever blocks.
+    // STREAMING: returns true once the last setStreamSource() or setStreamCallback()
+    //    has taken effect
     bool bufferReady();
     
+    // Flips (or flushes) only if bufferReady(), so it never blocks. Returns true
+    // if the flip was made.
+    bool flipBuffersAsync(void);
+    // Called from the DMA interrupt each time a frame has been sent in full, i.e.
+    // at the start of the frame blanking period. In continuous modes any flip or
+    // present has been taken up by then, so it suits pacing the renderer.
+    void setFrameCallback(FrameCallback callback, void *context = nullptr);
+    // Sleep with WFI instead of spinning when flipBuffers() or waitForVblank() have
+    // to wait. Any interrupt wakes the CPU, the end of frame one included.
+    void setSleepWhileWaiting(bool enable) { sleepWhileWaiting = enable; }
+    // Frames sent in full since begin(); wraps around.
+    uint32_t getFrameCount() { return frameCount; }
+    // Continuous modes: true while a flip, queued buffer or present has yet to be
+    // taken up at the next frame blanking period.
+    bool swapPending();
+    // Waits for the end of the frame being sent. Returns false after timeoutMs, or
+    // at once if no frame is being sent.
+    bool waitForVblank(uint32_t timeoutMs = 1000);
+    // Continuous modes: stop refreshing once an unchanged frame has been sent
+    // idleAfter times, which leaves the eDMA and memory bus to other masters, and
+    // resume at the next flip or present. Every keepAliveMs the frame is still sent
+    // once, e.g. to recover LEDs from glitches on the line; 0 for never. idleAfter
+    // 0 refreshes continually, as by default. Returns true on success.
+    bool setIdlePolicy(uint16_t idleAfter, uint16_t keepAliveMs = 0);
+    bool refreshIdle() { return idling; }
+    // Share of the time since resetRefreshStatistics() or power up that the refresh
+    // DMA was running, 0 to 1; good for spans of up to 71 minutes.
+    float getRefreshLoad();
+    void resetRefreshStatistics();
+    
+    // DOUBLE_BUFFER_CONTINUOUS and QUEUED_CONTINUOUS: send an external frame by pointer
+    // from the next frame blanking period on, until the next flip or present. A frame
+    // is registered once, which writes it back from the data cache, and again after
+    // any change made while its refs were 0. Returns true on success.
+    bool registerFrame(ExternalFrame &frame);
+    bool presentFrame(ExternalFrame &frame);
+    
+    // SINGLE_BUFFER and DOUBLE_BUFFER: build a TCD chain in the store that loops
+    // over the frames, then play it with no CPU involvement at all. Playing another
+    // sequence switches at the end of the current loop; sequenceActive() tells when
+    // a store is no longer read. Flips and flushes are ignored while a sequence
+    // plays; after stopSequence() the next one waits for the loop to end. The
+    // functions returning bool return true on success.
+    bool buildSequence(SequenceStore &store, const SequenceFrame *frames, unsigned count);
+    bool playSequence(SequenceStore &store);
+    void stopSequence(); // at the end of the current loop
+    bool sequenceActive(const SequenceStore &store);
+    
+    // Optional second DMA channel filling and copying whole buffers, so clearing or
+    // copying frames costs no CPU time. Enable after begin(). One operation runs at
+    // a time and the destination must not be touched until the callback, if any, is
+    // called from the DMA interrupt. The pattern is repeated as 32 bit words; the
+    // source of a copy may be any buffer or registered frame. Returns true on success.
+    bool setMemoryDma(bool enable);
+    bool fillBuffer(volatile uint8_t *buffer, uint32_t pattern = 0,
+      MemoryDmaCallback callback = nullptr, void *context = nullptr);
+    bool copyBuffer(volatile uint8_t *to, const volatile uint8_t *from,
+      MemoryDmaCallback callback = nullptr, void *context = nullptr);
+    bool memoryDmaBusy() { return memBusy; }
+    
+    // Retained mode for DOUBLE_BUFFER and DOUBLE_BUFFER_CONTINUOUS: after a flip the
+    // inactive buffer is brought up to date with the frame just shown by copying the
+    // blocks that changed, so drawing only the changes is enough. In continuous mode
+    // the copy is made once the flip has taken effect, by whichever comes first of
+    // bufferReady(), waitForVblank(), getInactiveBufferPtr(), the inactive pixel
+    // functions and the next flip; all but bufferReady() wait for the flip to take
+    // effect, up to a frame, so nothing is drawn into the buffer still being sent.
+    void setRetainedMode(bool enable) { retained = enable; }
+    
+    // Reset gap sent after every frame, in microseconds rounded up to whole bit
+    // times (1.25uS by default); a ResetInterval preset or any value up to 32767
+    // bit times. Takes effect from the next frame on. Returns true on success.
+    bool setResetInterval(uint16_t microseconds);
+    uint16_t getResetInterval() { return resetMicroseconds; }
+    
+    // Sends only the first count pixels of each strip, e.g. when the installed
+    // strips are shorter than the buffer was built for; the buffer itself stays
+    // as it is. Takes effect at the next frame blanking period in continuous modes,
+    // else at the next flip or flush. Not for STREAMING. Returns true on success.
+    bool setActivePixelCount(uint16_t count);
+    uint16_t getActivePixelCount() { return activePixels; }
+    
+    void setQueuePolicy(QueuePolicy policy) { queuePolicy = policy; }
+    uint32_t getDroppedFrameCount() { return droppedFrames; } // LATEST_FRAME policy
+    
+    // STREAMING: frames are encoded from this store, which must have at least the
+    // driver's pixel count and the same channel count. A new
+    // store takes effect at the start of the next frame, so alternating between two
+    // stores gives tear free updates. A store is timed first and refused if a slice
+    // can't be encoded from it within the slice time, or with an odd number of
+    // slices, within the reset gap; so are such reset intervals and, by begin(),
+    // slice sizes. Returns true on success.
+    bool setStreamSource(CompactStore &store);
+    // STREAMING: frames are computed by the callback instead, in blocks of up to
+    // StreamCallbackRows pixel indices, with no frame memory at all. The callback's
+    // own time has to fit in what the encoding leaves of the slice time. Takes effect
+    // at the start of the next frame. Returns true on success.
+    bool setStreamCallback(StreamCallback callback, void *context = nullptr);
+    static const uint16_t StreamCallbackRows = 8;
+    // slices the DMA reached before they were encoded, e.g. held up by interrupts
+    // of higher priority or by interrupts disabled for too long, and the longest
+    // encode in CPU cycles
+    uint32_t getUnderrunCount() { return streamUnderruns; }
+    uint32_t getMaxEncodeCycles() { return streamMaxCycles; }
+    void resetStreamStatistics() { streamUnderruns = 0; streamMaxCycles = 0; }
+    
     void setPixel(uint8_t channel, uint16_t pixelIndex, const Color &color) {
       setActivePixel(channel, pixelIndex, color);
     }
@@ -138,6 +519,7 @@ class PixelDriver
       setPixel(channel, pixelIndex, color, activeBuffer);
     }
     void setInactivePixel(uint8_t channel, uint16_t pixelIndex, const Color &color) {
+      retainIfDue();
       setPixel(channel, pixelIndex, color, inactiveBuffer);
     }
     
@@ -148,95 +530,475 @@ class PixelDriver
       return getPixel(channel, pixelIndex, activeBuffer);
     }
     Color getInactivePixel(uint8_t channel, uint16_t pixelIndex) {
+      retainIfDue();
       return getPixel(channel, pixelIndex, inactiveBuffer);
     }
     
-    // for advanced buffer manipulation by user application
-    volatile uint8_t* getActiveBufferPtr() { return reinterpret_cast<volatile uint8_t*>(activeBuffer); }
-    volatile uint8_t* getInactiveBufferPtr() { return reinterpret_cast<volatile uint8_t*>(inactiveBuffer); }
+    // encode one pixel index of all channels at once; colors[n] is for channel n
+    // and always 32 entries long (64 with 64 channels), the entries beyond the
+    // channel count are ignored.
+    // The pixel access functions have no effect in STREAMING mode, use the CompactStore.
+    void setPixelRow(uint16_t pixelIndex, const Color *colors) {
+      setActivePixelRow(pixelIndex, colors);
+    }
+    void setActivePixelRow(uint16_t pixelIndex, const Color *colors) {
+      setPixelRow(pixelIndex, colors, activeBuffer);
+    }
+    void setInactivePixelRow(uint16_t pixelIndex, const Color *colors) {
+      retainIfDue();
+      setPixelRow(pixelIndex, colors, inactiveBuffer);
+    }
+    
+    // for advanced buffer manipulation by user application; writes through these
+    // pointers are not tracked, see markDirty()
+    volatile uint8_t* getActiveBufferPtr() { return activeBuffer; }
+    volatile uint8_t* getInactiveBufferPtr() { retainIfDue(); return inactiveBuffer; }
     size_t getBufferSize() { return ip->bsz; };
+    uint16_t getPixelCount() { return ip->pxls; }
+    uint8_t getChannelCount() { return clocked() ? ip->chs / 2 : ip->chs; }
+    BufferMode getBufferMode() { return ip->bm; }
+    
+    // Dirty tracking: the write APIs record which blocks of each buffer changed
+    // since the buffer was last sent. Bit n of the map (word n / 32, bit n % 32)
+    // covers bytes n * getDirtyBlockSize() onwards of the buffer. When enabled,
+    // flipBuffers() only flushes the dirty blocks from the data cache, so
+    // anything written through the raw buffer pointers must call markDirty().
+    void setDirtyTracking(bool enable) { dirtyTracking = enable; }
+    // SINGLE_BUFFER, and DOUBLE_BUFFER in retained mode: flushBuffer() and
+    // flipBuffers() only send the pixels up to the highest dirty one, as the
+    // LEDs further down the strips keep what they last latched. Only tracked
+    // writes count: a raw write past the highest dirty pixel is not sent unless
+    // it is passed to markDirty().
+    void setTruncatedFrames(bool enable) { truncating = enable; }
+    size_t getDirtyBlockSize() { return size_t(1) << dirtyBlockShift; }
+    size_t getDirtyBlockCount() { return (ip->bsz + getDirtyBlockSize() - 1) >> dirtyBlockShift; }
+    // nullptr for a pointer other than getActiveBufferPtr() or getInactiveBufferPtr()
+    const uint32_t* getDirtyMap(volatile const uint8_t *buffer) { return dirtyMapOf(buffer); }
+    void markDirty(volatile const uint8_t *buffer, size_t offset, size_t length) { // ignores other pointers
+      if (length && offset + length <= ip->bsz) markDirtyBytes(buffer, offset, length);
+    }
 
   private:
     void dmaIsr(void);
+    void waitForDma();
+    void endFrame();
+    bool takeNextFrame();
+    void resumeRefresh(bool wait = true); // else retry later if the DMA still runs
+    void memoryDmaIsr(void);
+    bool startMemoryDma(volatile uint8_t *to, const volatile uint8_t *from,
+      MemoryDmaCallback callback, void *context);
+    void startMemoryChunk();
+    void flushCache(volatile uint8_t *buffer);
+    void setSegmentsSource(volatile uint8_t *buffer);
+    void setDataSegments(volatile uint8_t *buffer, size_t bytes);
+    void updateSegments(volatile uint8_t *buffer);
+    void prepareSegments(volatile uint8_t *buffer);
+    // bytes per pixel index sent: 32 bit pixels only if a channel is GRBW
+    size_t pixelStride() { return strideOf((ip->cc == QUADCOLOR && (quadChannels || clocked())) ? 32 : 24); }
+    size_t activeBytes();
+    size_t dirtyExtent(volatile const uint8_t *buffer, size_t limit);
+    bool allocateSegments(unsigned count);
+    void releaseSegments();
+    void flushSegments();
+    void setDataTransfer(DMABaseClass &d, volatile uint8_t *source, size_t bytes);
+    void setPresetZeros(DMASetting &d);
+    void setOnes(DMASetting &d);
+    void setZeros(DMASetting &d);
+    void setShifterWords(DMASetting &d, const uint32_t *source, int16_t sourceStep);
+    void loopZeros(DMASetting &d, uint16_t bitTimes);
+    void setLaneBurst(DMABaseClass::TCD_t *tcd);
+    // A shifter holds 32 / channels phases, or with lanes a phase takes a shifter
+    // per lane; the data phase follows the ones phases.
+    unsigned lanes() { return (ip->chs > 32 && ! clocked()) ? ip->chs / 32u : 1u; }
+    unsigned laneChannels() { return clocked() ? ip->chs / 2u : ip->chs / lanes(); }
+    unsigned dataWords() { return (ip->chs > 32) ? ip->chs / 32u : 1u; } // per DMA request
+    bool clocked() { return clockOutputs != 0; }
+    uint32_t clockedValue(const Color &color) {
+      return (0xE0u | globalBrightness) << 24 | uint32_t(color.RGB.blue) << 16
+        | uint32_t(color.RGB.green) << 8 | color.RGB.red;
+    }
+    void setClockBits(volatile uint8_t *buffer);
+    void setClockFrame(DMASetting &d, uint16_t bits);
+    unsigned phasesPerShifter() { return 32u / laneChannels(); }
+    unsigned shiftersOf(unsigned phases) { return (phases * lanes() + phasesPerShifter() - 1) / phasesPerShifter(); }
+    unsigned dataShifter() { return timing.onesPhases * lanes() / phasesPerShifter(); }
+    unsigned onesShifters() { return shiftersOf(timing.onesPhases); }
+    // Direct drive shifts a whole phase at once, out of a pin per channel.
+    bool direct() { return flexPins.SRCLK == NoPin; }
+    unsigned dataPins() { return direct() ? ip->chs : lanes(); }
+    uint8_t dataPin(unsigned index);
+    uint32_t bitTimesOf(uint32_t microseconds);
+    bool timingUsable(const BitTiming &t);
+    void end(); // undo begin(), nothing if not begun
     void configurePins(bool enable);
     void configureFlexIO(bool enable);
     void configurePll5(bool enable);
     void configureDma(bool enable);
+    void configureStream();
+    void streamIsr();
+    unsigned streamOrdinal();
+    void encodeSlice(unsigned slot, unsigned slice);
+    uint32_t encodeCycles(const CompactStore *store);
+    bool streamBudgetMet(const CompactStore *store, uint32_t resetBits);
+    void takeStreamSource() {
+      streamSource = pendingSource;
+      streamCallback = pendingCallback;
+      streamContext = pendingContext;
+      sourcePending = false;
+    }
+    unsigned streamBits() { return (ip->cc == QUADCOLOR) ? 32 : 24; }
     
-    void setPixel(uint8_t channel, uint16_t pixelIndex, const Color &color, volatile uint32_t *buffer) {
-      if (channel > 31 || pixelIndex >= ip->pxls) return;
+    static const unsigned MaxBufferSlots = MaxQueuedBuffers;
+    static const unsigned DirtyMapWords = 32; // up to 1024 blocks per buffer
 
-      const uint32_t channelMask = 1 << channel;
-      uint32_t pxlMask, pxlValue;
+    unsigned slotOf(volatile const uint8_t *buffer) { return (buffer - ip->bptr) / ip->bsz; }
+    volatile uint8_t* bufferOf(unsigned slot) { return ip->bptr + slot * ip->bsz; }
+    // nullptr unless buffer is the start of one of the driver's buffers; the
+    // slots of the active and inactive buffers are kept to spare the division
+    uint32_t* dirtyMapOf(volatile const uint8_t *buffer) {
+      unsigned slot = inactiveSlot;
+      if (bufferOf(slot) != buffer) slot = activeSlot;
+      if (bufferOf(slot) != buffer) {
+        if (buffer < ip->bptr) return nullptr;
+        slot = slotOf(buffer);
+        if (slot >= ip->bcnt || bufferOf(slot) != buffer) return nullptr;
+      }
+      return dirtyMaps[slot];
+    }
+    void markDirtyBytes(volatile const uint8_t *buffer, size_t offset, size_t length) {
+      uint32_t *map = dirtyMapOf(buffer);
+      if (! map) return;
+      const size_t last = (offset + length - 1) >> dirtyBlockShift;
+      for (size_t b = offset >> dirtyBlockShift; b <= last; ++b) map[b >> 5] |= 1u << (b & 31);
+    }
+    void flushDirty(volatile uint8_t *buffer);
+
+    // Buffer slot indices passed between application and ISR without locks:
+    // one side only pushes, the other only pops.
+    struct SlotQueue {
+      volatile uint8_t head;
+      volatile uint8_t tail;
+      uint8_t slots[MaxBufferSlots];
       
-      if (channelTypes[channel] == GRBW) {
-        buffer += 32u * pixelIndex;
-        pxlMask = 1 << 31;
-        pxlValue = color.raw;
-      } else {
-        buffer += 24u * pixelIndex;
-        pxlMask = 1 << 23;
-        pxlValue = color.raw >> 8;
+      bool push(uint8_t slot) {
+        const uint8_t h = head;
+        if (uint8_t(h - tail) == MaxBufferSlots) return false;
+        slots[h % MaxBufferSlots] = slot;
+        __asm__ volatile ("DMB" ::: "memory");
+        head = h + 1;
+        return true;
+      }
+      bool pop(uint8_t &slot) {
+        const uint8_t t = tail;
+        if (t == head) return false;
+        slot = slots[t % MaxBufferSlots];
+        __asm__ volatile ("DMB" ::: "memory");
+        tail = t + 1;
+        return true;
       }
+    };
+    void retainFrame();
+    void retainIfDue(); // waits for the swap to be taken first
+    bool acquireBuffer();
+    bool presentQueued();
+    bool takeFrameRequest();
+    void requestFrame(ExternalFrame *frame); // nullptr for the internal buffers
+    void setFrameRequest(ExternalFrame *frame); // with interrupts disabled
+    void releaseFrames(); // with the DMA stopped: back to the internal buffers
+    bool stageFlip();
+    void commitFlip(); // with interrupts disabled
+    void completeFlip();
+
+    // bits per pixel of a channel and bytes per pixel index in the buffer
+    unsigned bitsOf(uint8_t channel) { return (clocked() || channelTypes[channel] == GRBW) ? 32 : 24; }
+    size_t strideOf(unsigned bits) { return bits * (ip->chs / 8u); }
+
+    // 64 channels: the bit of a channel in the two words of a bit plane, see
+    // setDataTransfer()
+    static uint64_t laneMask(uint8_t channel) {
+      const unsigned c = channel & 31u;
+      return uint64_t(1) << (((c >= 16) ? 0 : 32) + 2 * (c & 15u) + 1 - (channel >> 5));
+    }
+
+    template<typename T>
+    static void setBits(volatile T *buffer, T channelMask, uint32_t value, unsigned bits) {
+      uint32_t pxlMask = 1u << (bits - 1);
       
       while (pxlMask) {
-        if (pxlValue & pxlMask) {
+        if (value & pxlMask) {
           *buffer |= channelMask;
         } else {
-          *buffer &= ~channelMask;
+          *buffer &= T(~channelMask);
         }
         ++buffer;
         pxlMask >>= 1;
       }
     }
     
-    Color getPixel(uint8_t channel, uint16_t pixelIndex, volatile uint32_t *buffer) {
-      if (channel > 31 || pixelIndex >= ip->pxls) return Color();
+    template<typename T>
+    static uint32_t getBits(volatile T *buffer, T channelMask, unsigned bits) {
+      uint32_t value = 0;
       
-      const uint32_t channelMask = 1 << channel;
-      unsigned count;
-      Color c;
-      c.raw = 0;
+      while (bits--) {
+        value <<= 1;
+        if (*buffer++ & channelMask) value |= 1;
+      }
+      
+      return value;
+    }
+
+    void setPixel(uint8_t channel, uint16_t pixelIndex, const Color &color, volatile uint8_t *buffer) {
+      if (channel >= ip->chs || pixelIndex >= ip->pxls || ip->bm == STREAMING) return;
+      if (clocked()) {
+        setClockedPixel(channel, pixelIndex, color, buffer);
+        return;
+      }
+
+      const unsigned bits = bitsOf(channel);
+      const uint32_t value = (bits == 32) ? color.raw : color.raw >> 8;
+      const size_t stride = strideOf(bits);
+      markDirtyBytes(buffer, stride * pixelIndex, stride);
+      buffer += stride * pixelIndex;
       
-      if (channelTypes[channel] == GRBW) {
-        buffer += 32u * pixelIndex + 32u;
-        count = 32;
-      } else {
-        buffer += 24u * pixelIndex + 24u;
-        count = 24;
+      switch (ip->chs) {
+        case 8: setBits(buffer, uint8_t(1u << channel), value, bits); break;
+        case 16: setBits(reinterpret_cast<volatile uint16_t*>(buffer), uint16_t(1u << channel), value, bits); break;
+        case 64: setBits(reinterpret_cast<volatile uint64_t*>(buffer), laneMask(channel), value, bits); break;
+        default: setBits(reinterpret_cast<volatile uint32_t*>(buffer), 1u << channel, value, bits); break;
       }
+    }
+    
+    void setPixelRow(uint16_t pixelIndex, const Color *colors, volatile uint8_t *buffer);
+    void setLaneRow(uint16_t pixelIndex, const Color *colors, volatile uint8_t *buffer);
+    void setClockedRow(uint16_t pixelIndex, const Color *colors, volatile uint8_t *buffer);
+    
+    // Clocked LEDs: a data output's bit is in both halves of a bit plane.
+    void setClockedPixel(uint8_t channel, uint16_t pixelIndex, const Color &color, volatile uint8_t *buffer) {
+      const unsigned outputs = laneChannels();
+      if (channel >= outputs || (clockOutputs & (1u << channel))) return;
+      const size_t stride = strideOf(32);
+      markDirtyBytes(buffer, stride * pixelIndex, stride);
+      buffer += stride * pixelIndex;
+      const uint64_t mask = (uint64_t(1) << outputs | 1u) << channel;
       
-      while (count--) {
-        --buffer;
-        c.raw >>= 1;
-        if (*buffer & channelMask) {
-          c.raw |= 1 << 31;
+      switch (ip->chs) {
+        case 8: setBits(buffer, uint8_t(mask), clockedValue(color), 32); break;
+        case 16: setBits(reinterpret_cast<volatile uint16_t*>(buffer), uint16_t(mask), clockedValue(color), 32); break;
+        case 32: setBits(reinterpret_cast<volatile uint32_t*>(buffer), uint32_t(mask), clockedValue(color), 32); break;
+        default: setBits(reinterpret_cast<volatile uint64_t*>(buffer), mask, clockedValue(color), 32); break;
+      }
+    }
+
+    Color getPixel(uint8_t channel, uint16_t pixelIndex, volatile uint8_t *buffer) {
+      if (channel >= ip->chs || pixelIndex >= ip->pxls || ip->bm == STREAMING) return Color();
+      if (clocked()) {
+        if (channel >= laneChannels()) return Color();
+        buffer += strideOf(32) * pixelIndex;
+        uint32_t v;
+        switch (ip->chs) {
+          case 8: v = getBits(buffer, uint8_t(1u << channel), 32); break;
+          case 16: v = getBits(reinterpret_cast<volatile uint16_t*>(buffer), uint16_t(1u << channel), 32); break;
+          case 32: v = getBits(reinterpret_cast<volatile uint32_t*>(buffer), 1u << channel, 32); break;
+          default: v = getBits(reinterpret_cast<volatile uint64_t*>(buffer), uint64_t(1) << channel, 32); break;
         }
+        return rgb(uint8_t(v), uint8_t(v >> 8), uint8_t(v >> 16));
+      }
+      
+      const unsigned bits = bitsOf(channel);
+      buffer += strideOf(bits) * pixelIndex;
+      uint32_t value;
+      
+      switch (ip->chs) {
+        case 8: value = getBits(buffer, uint8_t(1u << channel), bits); break;
+        case 16: value = getBits(reinterpret_cast<volatile uint16_t*>(buffer), uint16_t(1u << channel), bits); break;
+        case 64: value = getBits(reinterpret_cast<volatile uint64_t*>(buffer), laneMask(channel), bits); break;
+        default: value = getBits(reinterpret_cast<volatile uint32_t*>(buffer), 1u << channel, bits); break;
       }
       
+      Color c;
+      c.raw = (bits == 32) ? value : value << 8;
       return c;
     }
 
     static unsigned instanceCount;
     static PixelDriver *instances[2];
+    static const unsigned EmbeddedDataSegments = 4;
+    static uint8_t pllDiv; // PLL5 multiplier while running
+    static const unsigned MaxTimingShifters = 8; // of a FlexIO module
     
     const InternalProperties * const ip;
-    const unsigned dmasDataSegmentsCount;
+    unsigned dmasDataSegmentsCount;
     FlexIOModule flexIOModule;
     FlexPins flexPins;
     FlexIOHandler *pFlex;
     DMAChannel dmaChannel;
     DMASetting dmasPresetZeros;
     DMASetting dmasSetOnes;
-    DMASetting dmasDataSegments[4];
+    DMASetting *dmasDataSegments; // dmasEmbeddedSegments, or allocated by begin() for long strips
+    DMASetting dmasEmbeddedSegments[EmbeddedDataSegments];
     DMASetting dmasSetZeros;
     DMASetting dmasLoopZeros;
-    ChannelType channelTypes[32];
-    volatile uint32_t * activeBuffer;
-    volatile uint32_t * inactiveBuffer;
+    ChannelType channelTypes[64];
+    uint64_t quadChannels; // bit mask of GRBW channels
+    bool flushRequired; // buffer memory is cached write-back
+    bool dirtyTracking;
+    uint8_t dirtyBlockShift;
+    uint32_t dirtyMaps[MaxBufferSlots][DirtyMapWords];
+    volatile uint8_t * activeBuffer;
+    volatile uint8_t * inactiveBuffer;
+    uint8_t activeSlot; // slot indices of the two buffers
+    uint8_t inactiveSlot;
+    SlotQueue freeBuffers; // refilled by the ISR
+    SlotQueue readyBuffers; // filled by flipBuffers()
+    bool renderBufferHeld; // inactiveBuffer was taken from freeBuffers
+    QueuePolicy queuePolicy;
+    volatile uint32_t droppedFrames;
+    bool retained;
+    bool retainPending; // retainFrame() due once the flip took effect
+    uint32_t retainMap[DirtyMapWords]; // blocks changed in the frame last flipped
+    ExternalFrame *requestedFrame;
+    ExternalFrame *shownFrame; // instead of activeBuffer
+    volatile bool frameRequested;
+    SequenceStore *playingSequence;
+    CompactStore *streamSource; // being sent
+    StreamCallback streamCallback;
+    void *streamContext;
+    CompactStore *pendingSource; // from the next frame on
+    StreamCallback pendingCallback;
+    void *pendingContext;
+    volatile bool sourcePending;
+    unsigned streamSlicePixels;
+    unsigned streamSlices; // per frame, the last one padded with black
+    unsigned streamPasses; // over the ring per frame, a data segment TCD each
+    unsigned streamSeen; // slice the DMA read at the last interrupt, streamSlices between frames
+    uint32_t streamFrame; // frames begun, counted by streamIsr()
+    uint32_t streamHeld[2]; // frame * streamSlices + slice encoded in each slot
+    uint32_t streamSourceFrame; // first frame encoded from streamSource
+    volatile uint32_t streamUnderruns;
+    volatile uint32_t streamMaxCycles;
+    BitTiming timing; // phases 0 until begin() for the default
+    uint32_t onesPatterns[MaxTimingShifters];
+    uint16_t activePixels;
+    volatile bool lengthPending; // activePixels changed, see updateSegments()
+    size_t segmentBytes; // sent by the data segments
+    bool truncating;
+    uint16_t resetMicroseconds;
+    uint16_t resetBitTimes;
+    volatile bool swapRequested; // DOUBLE_BUFFER_CONTINUOUS flip for the ISR
+    volatile uint32_t frameCount;
+    FrameCallback frameCallback;
+    void *frameContext;
+    bool sleepWhileWaiting;
+    uint32_t clockOutputs; // clocked LEDs, see setClockOutputs()
+    uint32_t clockPatterns[2]; // a zero bit, the clock low then high
+    uint8_t globalBrightness;
+    uint16_t idleAfter;
+    uint16_t unchangedFrames; // sent since the last change
+    volatile bool idling; // the DMA stops or has stopped at the end of the reset period
+    IntervalTimer keepAliveTimer;
+    uint32_t idleSince; // micros()
+    uint32_t idleMicros;
+    uint32_t statsSince;
+    DMAChannel memDma; // allocated by setMemoryDma()
+    bool memDmaEnabled;
+    volatile bool memBusy;
+    uint32_t memPattern;
+    volatile uint8_t *memTo;
+    const volatile uint8_t *memFrom; // nullptr to fill
+    size_t memRemaining;
+    MemoryDmaCallback memCallback;
+    void *memContext;
     
     friend void dmaIsr0();
     friend void dmaIsr1();
+    friend void memoryDmaIsr0();
+    friend void memoryDmaIsr1();
+    friend void keepAliveIsr0();
+    friend void keepAliveIsr1();
+    friend class DualPixelDriver;
+};
+
+// Both FlexIO modules as one 64 channel display: channels 0 -> 31 are sent by the
+// FLEXIO1 driver, 32 -> 63 by the FLEXIO2 one. Both run off the same PLL5 bit clock
+// and begin() starts their DMA chains together, so their frames stay in lockstep,
+// and a flip takes effect on both in the same frame blanking period. The two buffers
+// must have the same layout, 32 channels each; not for STREAMING. Other settings go
+// to getDriver(), but in continuous modes anything that changes the frame length of
+// one driver only, or its idle policy, ends the lockstep.
+class DualPixelDriver
+{
+  public:
+    FLASHMEM DualPixelDriver(const InternalProperties* ip1, const InternalProperties* ip2);
+    FLASHMEM void setChannelType(uint8_t channel, ChannelType type); // channels 0 -> 63
+    FLASHMEM bool begin(FlexPins flexPins1, FlexPins flexPins2); // returns true on success
+    
+    // As PixelDriver's, for both drivers; after begin() only with the same pllDiv.
+    bool setBitTiming(const BitTiming &bitTiming);
+    bool setResetInterval(uint16_t microseconds);
+    template<Chipset chipset>
+    bool setChipset() {
+      constexpr BitTiming t = solveBitTiming(chipsetProfile(chipset), 32);
+      static_assert(t.phases, "chipset bit timing not reachable with this channel count");
+      return setTimingAndReset(t, chipsetProfile(chipset).resetUs);
+    }
+    
+    void flipBuffers(void);
+    void flushBuffer(void) { flipBuffers(); }
+    bool bufferReady() { return first.bufferReady() && second.bufferReady(); }
+    bool waitForVblank(uint32_t timeoutMs = 1000); // of both drivers
+    void setSleepWhileWaiting(bool enable) {
+      first.setSleepWhileWaiting(enable);
+      second.setSleepWhileWaiting(enable);
+    }
+    
+    void setPixel(uint8_t channel, uint16_t pixelIndex, const Color &color) {
+      setActivePixel(channel, pixelIndex, color);
+    }
+    void setActivePixel(uint8_t channel, uint16_t pixelIndex, const Color &color) {
+      if (channel < 32) first.setActivePixel(channel, pixelIndex, color);
+      else second.setActivePixel(channel - 32, pixelIndex, color);
+    }
+    void setInactivePixel(uint8_t channel, uint16_t pixelIndex, const Color &color) {
+      if (channel < 32) first.setInactivePixel(channel, pixelIndex, color);
+      else second.setInactivePixel(channel - 32, pixelIndex, color);
+    }
+    
+    Color getPixel(uint8_t channel, uint16_t pixelIndex) {
+      return getActivePixel(channel, pixelIndex);
+    }
+    Color getActivePixel(uint8_t channel, uint16_t pixelIndex) {
+      if (channel < 32) return first.getActivePixel(channel, pixelIndex);
+      return second.getActivePixel(channel - 32, pixelIndex);
+    }
+    Color getInactivePixel(uint8_t channel, uint16_t pixelIndex) {
+      if (channel < 32) return first.getInactivePixel(channel, pixelIndex);
+      return second.getInactivePixel(channel - 32, pixelIndex);
+    }
+    
+    // encode one pixel index of all channels at once; colors[n] is for channel n
+    // and 64 entries long
+    void setPixelRow(uint16_t pixelIndex, const Color *colors) {
+      setActivePixelRow(pixelIndex, colors);
+    }
+    void setActivePixelRow(uint16_t pixelIndex, const Color *colors) {
+      first.setActivePixelRow(pixelIndex, colors);
+      second.setActivePixelRow(pixelIndex, colors + 32);
+    }
+    void setInactivePixelRow(uint16_t pixelIndex, const Color *colors) {
+      first.setInactivePixelRow(pixelIndex, colors);
+      second.setInactivePixelRow(pixelIndex, colors + 32);
+    }
+    
+    uint16_t getPixelCount() { return first.getPixelCount(); }
+    uint8_t getChannelCount() { return 64; }
+    PixelDriver& getDriver(FlexIOModule module) { return (module == FLEXIO1) ? first : second; }
+
+  private:
+    void syncFrames();
+    bool setTimingAndReset(const BitTiming &bitTiming, uint16_t resetUs);
+    
+    PixelDriver first;
+    PixelDriver second;
 };
 
 } // namespace TDWS28XX
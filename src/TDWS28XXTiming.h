@@ -0,0 +1,189 @@
+/* MIT License
+
+Copyright (c) 2021 Arn Mulligan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef TDWS28XX_TIMING_H
+#define TDWS28XX_TIMING_H
+
+#include <stdint.h>
+
+namespace TDWS28XX {
+
+// Each pixel bit is sent as a number of equal phases, each one shift register
+// word long: the first onesPhases are high, the next one carries the data and
+// the rest are low. So a 0 bit is high for onesPhases and a 1 bit for one phase
+// more. The phase length follows from PLL5 (24MHz * pllDiv), the FlexIO clock
+// dividers and the SRCLK divider; see solveBitTiming().
+struct BitTiming
+{
+  uint8_t pllDiv; // PLL5 multiplier, 27 to 54
+  uint8_t flexPred; // FlexIO clock dividers, 1 to 8 each
+  uint8_t flexPodf;
+  uint16_t srclkDiv; // FlexIO clocks per half SRCLK cycle, 1 to 256
+  uint8_t phases; // per pixel bit; 0 if the timing is not reachable
+  uint8_t onesPhases;
+  uint8_t channels; // 8, 16 or 32, as the pixel buffer
+  uint16_t bitPeriod; // nS, rounded
+};
+
+// The timing used unless told otherwise: 3 phases of 416.7nS, 1.25uS per bit.
+constexpr BitTiming defaultBitTiming(uint8_t channels) {
+  return { 32, 5, 1, uint16_t(32 / channels), 3, 1, channels, 1250 };
+}
+
+// Clocked LEDs, see PixelDriver::setClockOutputs(): 2 phases of a shift per output
+// per bit, the clock low then high, by default 833.3nS (1.2MHz) for 32 outputs,
+// 416.7nS (2.4MHz) for 16, and so on down to 104.2nS (9.6MHz) for 4. A flexPred of 3 overclocks
+// FlexIO to 256MHz for 60% of that, as far as the shift registers keep up.
+constexpr BitTiming clockedBitTiming(uint8_t flexPred = 5, uint8_t outputs = 32) {
+  return { 32, flexPred, 1, 1, 2, 0, outputs, uint16_t(4000u * outputs * flexPred / 768u) };
+}
+
+// Datasheet bit timing of an LED chipset in nS, each high time within
+// +/- tolerance. Longer low times are fine, so a bit may take longer than
+// bitPeriod but not less than bitPeriod - tolerance.
+struct ChipsetProfile
+{
+  uint16_t bitPeriod;
+  uint16_t t0h;
+  uint16_t t1h;
+  uint16_t tolerance;
+  uint16_t resetUs;
+};
+
+enum Chipset {
+  WS2812,
+  WS2812B,
+  WS2811,
+  WS2811_400KHZ,
+  WS2813,
+  SK6812,
+  TM1814,
+  UCS1903
+};
+
+constexpr ChipsetProfile chipsetProfile(Chipset chipset) {
+  return (chipset == WS2812) ? ChipsetProfile{ 1250, 350, 700, 150, 50 }
+    : (chipset == WS2812B) ? ChipsetProfile{ 1250, 400, 800, 150, 280 }
+    : (chipset == WS2811) ? ChipsetProfile{ 1250, 250, 600, 150, 280 }
+    : (chipset == WS2811_400KHZ) ? ChipsetProfile{ 2500, 500, 1200, 150, 280 }
+    : (chipset == WS2813) ? ChipsetProfile{ 1250, 300, 750, 150, 300 }
+    : (chipset == SK6812) ? ChipsetProfile{ 1250, 300, 600, 150, 80 }
+    : (chipset == TM1814) ? ChipsetProfile{ 1250, 360, 720, 150, 200 }
+    : ChipsetProfile{ 1250, 400, 850, 150, 50 }; // UCS1903
+}
+
+// WS2812 class timing scaled to an overclocked bit rate in Hz: the high times
+// stay at about a third and two thirds of the bit period.
+constexpr ChipsetProfile overclockProfile(uint32_t bitRate, uint16_t resetUs = 280) {
+  return { uint16_t(1000000000u / bitRate), uint16_t(320000000u / bitRate),
+    uint16_t(640000000u / bitRate), uint16_t(120000000u / bitRate), resetUs };
+}
+
+namespace solver { // solver internals
+
+const unsigned MinPllDiv = 27;
+const unsigned MaxPllDiv = 54;
+const unsigned MaxFlexClock = 153600000; // Hz, the highest known to work
+const unsigned OverclockFlexClock = 256000000; // Hz, for overclocking; find the margin by commissioning
+const unsigned MaxBitsPerPixelBit = 128; // 8 bit baud counter of timer 0
+
+constexpr double distance(double a, double b) { return (a > b) ? a - b : b - a; }
+
+constexpr bool inSpec(double t, uint16_t nominal, uint16_t tolerance) {
+  return distance(t, nominal) <= tolerance;
+}
+
+// pred (1 to 8) of a FlexIO clock divider product with podf also 1 to 8, or 0
+constexpr unsigned predOf(unsigned product) {
+  for (unsigned pred = 8; pred; --pred) {
+    if (product % pred == 0 && product / pred <= 8) return pred;
+  }
+  return 0;
+}
+
+// FlexIO clock divider product for the SRCLK divider product m, or 0
+constexpr unsigned flexDividerOf(unsigned m, unsigned minimum) {
+  for (unsigned q = minimum; q <= 64 && q <= m; ++q) {
+    if (m % q == 0 && m / q <= 256 && predOf(q)) return q;
+  }
+  return 0;
+}
+
+} // namespace solver
+
+// Finds the shortest bit period meeting the profile, preferring PLL5 at its
+// usual 768MHz so it can still be shared by two drivers. The result has 0
+// phases if the profile is not reachable with this many channels, e.g.
+//   constexpr BitTiming t = solveBitTiming(chipsetProfile(WS2811_400KHZ), 16);
+//   static_assert(t.phases, "not reachable");
+// Raising maxFlexClock to solver::OverclockFlexClock allows overclocking.
+constexpr BitTiming solveBitTiming(const ChipsetProfile &profile, uint8_t channels,
+    unsigned maxFlexClock = solver::MaxFlexClock) {
+  BitTiming best = { };
+  double bestPeriod = 0;
+  double bestError = 0;
+  if (channels != 8 && channels != 16 && channels != 32) return best;
+  
+  for (unsigned d = solver::MinPllDiv; d <= solver::MaxPllDiv; ++d) {
+    const double pll = 24e6 * d;
+    const unsigned qMin = unsigned((pll + maxFlexClock - 1) / maxFlexClock);
+    
+    /* m is the number of PLL clocks per half SRCLK cycle; a phase has 2 * channels of those. */
+    for (unsigned m = qMin; ; ++m) {
+      const double phase = 2e9 * channels * m / pll;
+      if (2 * phase > profile.t1h + profile.tolerance) break;
+      const unsigned q = solver::flexDividerOf(m, qMin);
+      if (! q) continue;
+      
+      for (unsigned a = unsigned(profile.t0h / phase); a <= unsigned(profile.t0h / phase) + 1; ++a) {
+        if (! a || ! solver::inSpec(a * phase, profile.t0h, profile.tolerance)) continue;
+        if (! solver::inSpec((a + 1) * phase, profile.t1h, profile.tolerance)) continue;
+        const double minimum = (profile.bitPeriod - profile.tolerance) / phase;
+        unsigned n = unsigned(minimum);
+        if (n < minimum) ++n;
+        if (n < a + 2) n = a + 2;
+        if (n * channels > solver::MaxBitsPerPixelBit) continue;
+        
+        const double period = n * phase;
+        const double error = solver::distance(a * phase, profile.t0h) + solver::distance((a + 1) * phase, profile.t1h);
+        const bool usual = d == 32;
+        const bool bestUsual = best.pllDiv == 32;
+        if (best.phases && period > bestPeriod + 0.5) continue;
+        if (best.phases && period > bestPeriod - 0.5) {
+          if (bestUsual && ! usual) continue;
+          if (bestUsual == usual && error >= bestError) continue;
+        }
+        const unsigned pred = solver::predOf(q);
+        best = { uint8_t(d), uint8_t(pred), uint8_t(q / pred), uint16_t(m / q),
+          uint8_t(n), uint8_t(a), channels, uint16_t(period + 0.5) };
+        bestPeriod = period;
+        bestError = error;
+      }
+    }
+  }
+  return best;
+}
+
+} // namespace TDWS28XX
+
+#endif // TDWS28XX_TIMING_H
@@ -0,0 +1,135 @@
+/* MIT License
+
+Copyright (c) 2021 Arn Mulligan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "TDWS28XXTransition.h"
+
+/* Blend all four byte lanes of a and b in one go: t = 0 gives a, t = 256 */
+/* gives b. Each multiply handles two lanes spaced 16 bits apart, and */
+/* 255 * 256 fits a 16 bit lane, so the lanes never carry into each other. */
+static inline uint32_t mix(uint32_t a, uint32_t b, uint32_t t) {
+  const uint32_t u = 256 - t;
+  uint32_t even = ((a & 0x00FF00FF) * u + (b & 0x00FF00FF) * t) >> 8;
+  uint32_t odd = ((a >> 8) & 0x00FF00FF) * u + ((b >> 8) & 0x00FF00FF) * t;
+  return (even & 0x00FF00FF) | (odd & 0xFF00FF00);
+}
+
+/* Cheap integer hash giving every channel and pixel its own dissolve threshold. */
+static inline uint32_t threshold(uint16_t pixelIndex, uint8_t channel) {
+  uint32_t h = (uint32_t)pixelIndex * 32u + channel;
+  h ^= h >> 7;
+  h *= 0x9E3779B1u;
+  return h >> 24;
+}
+
+namespace TDWS28XX {
+
+bool Transition::start(const SceneStore &from_, const SceneStore &to_, TransitionEffect effect_, uint16_t steps) {
+  /* Scene rows are 32 colors, setPixelRow() of a 64 channel driver reads 64. */
+  if (pd.getChannelCount() > 32) return false;
+  if (pd.getBufferMode() == STREAMING) return false;
+  if (from_.pxls < pd.getPixelCount() || to_.pxls < pd.getPixelCount()) return false;
+  from = &from_;
+  to = &to_;
+  effect = effect_;
+  stepCount = steps ? steps : 1;
+  step = 0;
+  activeBoundary = -1;
+  inactiveBoundary = -1;
+  return true;
+}
+
+bool Transition::update() {
+  if (! running()) return false;
+  if (! pd.bufferReady()) return true;
+  
+  const uint32_t t = 256u * step / stepCount;
+  switch (effect) {
+    case CROSSFADE:
+      blend(t);
+      break;
+    case WIPE:
+      wipe((uint32_t)pd.getPixelCount() * step / stepCount);
+      break;
+    case DISSOLVE:
+      dissolve(t);
+      break;
+  }
+  pd.flipBuffers();
+
+  /* Keep track of what each buffer holds so a wipe only redraws the strip */
+  /* of pixels between the old and the new edge. A queue hands out any free */
+  /* buffer next, whose content is unknown. */
+  if (pd.getBufferMode() == QUEUED_CONTINUOUS) {
+    activeBoundary = inactiveBoundary;
+    inactiveBoundary = -1;
+  } else if (pd.getActiveBufferPtr() != pd.getInactiveBufferPtr()) {
+    int32_t b = activeBoundary;
+    activeBoundary = inactiveBoundary;
+    inactiveBoundary = b;
+  } else {
+    activeBoundary = inactiveBoundary;
+  }
+  
+  ++step;
+  return true;
+}
+
+void Transition::wipe(uint16_t boundary) {
+  const uint16_t pxls = pd.getPixelCount();
+  uint16_t first = 0;
+  uint16_t last = pxls;
+  if (inactiveBoundary >= 0) {
+    first = (inactiveBoundary < boundary) ? inactiveBoundary : boundary;
+    last = (inactiveBoundary < boundary) ? boundary : inactiveBoundary;
+  }
+  for (uint16_t i = first; i < last; ++i) {
+    pd.setInactivePixelRow(i, (i < boundary) ? to->row(i) : from->row(i));
+  }
+  inactiveBoundary = boundary;
+}
+
+void Transition::blend(uint32_t t) {
+  const uint16_t pxls = pd.getPixelCount();
+  Color row[32];
+  for (uint16_t i = 0; i < pxls; ++i) {
+    const Color *a = from->row(i);
+    const Color *b = to->row(i);
+    for (unsigned c = 0; c < 32; ++c) row[c].raw = mix(a[c].raw, b[c].raw, t);
+    pd.setInactivePixelRow(i, row);
+  }
+  inactiveBoundary = -1;
+}
+
+void Transition::dissolve(uint32_t t) {
+  const uint16_t pxls = pd.getPixelCount();
+  Color row[32];
+  for (uint16_t i = 0; i < pxls; ++i) {
+    const Color *a = from->row(i);
+    const Color *b = to->row(i);
+    for (unsigned c = 0; c < 32; ++c) row[c] = (threshold(i, c) < t) ? b[c] : a[c];
+    pd.setInactivePixelRow(i, row);
+  }
+  inactiveBoundary = -1;
+}
+
+} // namespace TDWS28XX
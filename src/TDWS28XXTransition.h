@@ -0,0 +1,69 @@
+/* MIT License
+
+Copyright (c) 2021 Arn Mulligan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef TDWS28XX_TRANSITION_H
+#define TDWS28XX_TRANSITION_H
+
+#include "TDWS28XX.h"
+
+namespace TDWS28XX {
+
+enum TransitionEffect {
+  CROSSFADE, // blend every pixel from one scene to the other
+  WIPE, // sweep a hard edge along the pixel index of all channels
+  DISSOLVE // switch pixels over in a fixed pseudo random order
+};
+
+class Transition
+{
+  public:
+    Transition(PixelDriver &pd_) : pd(pd_), stepCount(0), step(0) { }
+    
+    // scenes must cover the pixel count of the driver and stay valid while running;
+    // scenes hold 32 channels, so 64 channel drivers are refused, as is STREAMING
+    // mode, which has no buffers to draw into. Returns true on success.
+    bool start(const SceneStore &from, const SceneStore &to, TransitionEffect effect, uint16_t steps);
+    
+    // call from loop(): when the driver is ready the next step is encoded into
+    // the inactive buffer and flipped; returns true while the transition is running
+    bool update();
+    bool running() const { return step <= stepCount && stepCount; }
+    
+  private:
+    void wipe(uint16_t boundary);
+    void blend(uint32_t t);
+    void dissolve(uint32_t t);
+
+    PixelDriver &pd;
+    const SceneStore *from;
+    const SceneStore *to;
+    TransitionEffect effect;
+    uint16_t stepCount;
+    uint32_t step; // runs to stepCount + 1, which may not fit 16 bits
+    int32_t activeBoundary; // wipe edge encoded into each buffer, -1 if unknown
+    int32_t inactiveBoundary;
+};
+
+} // namespace TDWS28XX
+
+#endif // TDWS28XX_TRANSITION_H